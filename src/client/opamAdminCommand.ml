@@ -160,70 +160,111 @@ let cache_urls repo_root repo_def =
   in
   repo_dl_cache @ global_dl_cache
 
-(* Downloads all urls of the given package to the given cache_dir *)
-let package_files_to_cache repo_root cache_dir cache_urls
-    ~recheck ?link (nv, prefix) =
+(* Lists the archives (main url and extra sources) of the given package, as
+   [(package, extra-source name, url file)] *)
+let package_archives repo_root (nv, prefix) =
   match
     OpamFileTools.read_opam
+      ~skip:["synopsis"; "description"; "build"; "install"; "remove";
+             "run-test"; "depends"; "depopts"; "conflicts"; "depexts";
+             "available"; "messages"; "post-messages"]
       (OpamRepositoryPath.packages repo_root prefix nv)
   with
-  | None -> Done (OpamPackage.Map.empty)
+  | None -> []
   | Some opam ->
-    let add_to_cache ?name urlf errors =
-      let label =
-        OpamPackage.to_string nv ^
-        OpamStd.Option.to_string ((^) "/") name
-      in
-      let checksums =
-        OpamHash.sort (OpamFile.URL.checksum urlf)
-      in
-      match checksums with
-      | [] ->
-        OpamConsole.warning "[%s] no checksum, not caching"
-          (OpamConsole.colorise `green label);
-        Done errors
-      | _::_ ->
-        let cache_files =
-          List.map (OpamRepository.cache_file cache_dir) checksums
-        in
-        let error_opt =
-          if not recheck && List.for_all OpamFilename.exists cache_files then
-            Done None
-          else
-            OpamRepository.pull_file_to_cache label
-              ~cache_urls ~cache_dir
-              checksums
-              (OpamFile.URL.url urlf :: OpamFile.URL.mirrors urlf)
-            @@| fun r -> match OpamRepository.report_fetch_result nv r with
-            | Not_available (_,m) -> Some m
-            | Up_to_date () | Result () -> None
-        in
-        error_opt @@| function
-        | Some m ->
-          OpamPackage.Map.update nv (fun l -> m::l) [] errors
-        | None ->
-          Stdlib.Option.iter (fun link_dir ->
-              let name =
-                OpamStd.Option.default
-                  (OpamUrl.basename (OpamFile.URL.url urlf))
-                  name
-              in
-              let link =
-                OpamFilename.Op.(link_dir / OpamPackage.to_string nv // name)
-              in
-              OpamFilename.link ~relative:true ~target:(List.hd cache_files) ~link)
-            link;
-          errors
+    (match OpamFile.OPAM.url opam with
+     | None -> []
+     | Some urlf -> [nv, None, urlf]) @
+    List.map (fun (name,urlf) ->
+        nv, Some (OpamFilename.Base.to_string name), urlf)
+      (OpamFile.OPAM.extra_sources opam)
+
+(* The host part of an url, used to limit the number of simultaneous downloads
+   from the same origin *)
+let url_host url =
+  let path = url.OpamUrl.path in
+  match OpamStd.String.cut_at path '/' with
+  | Some (host, _) -> host
+  | None -> path
+
+(* Journal of the archives whose integrity was already verified by an
+   interrupted [--check-all] run. It is removed once a run completes. *)
+let cache_journal cache_dir =
+  OpamFilename.Op.(cache_dir // ".opam-admin-cache.journal")
+
+let read_cache_journal cache_dir =
+  let file = cache_journal cache_dir in
+  if OpamFilename.exists file then
+    OpamStd.String.Set.of_list
+      (OpamStd.String.split (OpamFilename.read file) '\n')
+  else OpamStd.String.Set.empty
+
+(* Downloads the given archive of a package to the given cache_dir *)
+let archive_to_cache cache_dir cache_urls ~recheck ?link ?journal
+    (nv, name, urlf) =
+  let label =
+    OpamPackage.to_string nv ^
+    OpamStd.Option.to_string ((^) "/") name
+  in
+  let checksums =
+    OpamHash.sort (OpamFile.URL.checksum urlf)
+  in
+  let errors = OpamPackage.Map.empty in
+  match checksums with
+  | [] ->
+    OpamConsole.warning "[%s] no checksum, not caching"
+      (OpamConsole.colorise `green label);
+    Done errors
+  | _::_ ->
+    let cache_files =
+      List.map (OpamRepository.cache_file cache_dir) checksums
+    in
+    let verified, journal =
+      match journal with
+      | None -> false, None
+      | Some (verified, oc) ->
+        List.for_all (fun ck ->
+            OpamStd.String.Set.mem (OpamHash.to_string ck) verified)
+          checksums,
+        Some oc
     in
-    let urls =
-      (match OpamFile.OPAM.url opam with
-       | None -> []
-       | Some urlf -> [add_to_cache urlf]) @
-      (List.map (fun (name,urlf) ->
-           add_to_cache ~name:(OpamFilename.Base.to_string name) urlf)
-          (OpamFile.OPAM.extra_sources opam))
+    let error_opt =
+      if (not recheck || verified) &&
+         List.for_all OpamFilename.exists cache_files then
+        Done None
+      else
+        OpamRepository.pull_file_to_cache label
+          ~cache_urls ~cache_dir
+          checksums
+          (OpamFile.URL.url urlf :: OpamFile.URL.mirrors urlf)
+        @@| fun r -> match OpamRepository.report_fetch_result nv r with
+        | Not_available (_,m) -> Some m
+        | Up_to_date () | Result () -> None
     in
-    OpamProcess.Job.seq urls OpamPackage.Map.empty
+    error_opt @@| function
+    | Some m ->
+      OpamPackage.Map.add nv [m] errors
+    | None ->
+      Stdlib.Option.iter (fun oc ->
+          if not verified then
+            (List.iter (fun ck ->
+                 output_string oc (OpamHash.to_string ck);
+                 output_char oc '\n')
+                checksums;
+             flush oc))
+        journal;
+      Stdlib.Option.iter (fun link_dir ->
+          let name =
+            OpamStd.Option.default
+              (OpamUrl.basename (OpamFile.URL.url urlf))
+              name
+          in
+          let link =
+            OpamFilename.Op.(link_dir / OpamPackage.to_string nv // name)
+          in
+          OpamFilename.link ~relative:true ~target:(List.hd cache_files) ~link)
+        link;
+      errors
 
 let cache_command_doc = "Fills a local cache of package archives"
 let cache_command cli =
@@ -258,12 +299,20 @@ let cache_command cli =
       "JOBS" "Number of parallel downloads"
       OpamArg.positive_integer 8
   in
+  let jobs_per_host_arg =
+    OpamArg.mk_opt ~cli OpamArg.(cli_from cli2_6) ["jobs-per-host"]
+      "JOBS" "Maximum number of parallel downloads from the same host"
+      OpamArg.positive_integer 4
+  in
   let recheck_arg =
     OpamArg.mk_flag ~cli OpamArg.(cli_from cli2_2) ["check-all"; "c"]
       "Run a full integrity check on the existing cache. If this is not set, \
-       only missing cache files are handled."
+       only missing cache files are handled. If a previous run with this \
+       option was interrupted, the archives it already verified are not \
+       checked again."
   in
-  let cmd global_options cache_dir no_repo_update link jobs recheck () =
+  let cmd global_options cache_dir no_repo_update link jobs jobs_per_host
+      recheck () =
     OpamArg.apply_global_options cli global_options;
     (* this option was the default until 2.1 *)
     let recheck = recheck || OpamCLIVersion.Op.(cli @< OpamArg.cli2_2) in
@@ -274,20 +323,57 @@ let cache_command cli =
     let pkg_prefixes = OpamRepository.packages_with_prefixes repo_root in
     let cache_urls = cache_urls repo_root repo_def in
 
+    let archives =
+      OpamPackage.Map.fold (fun nv prefix acc ->
+          List.rev_append (package_archives repo_root (nv, prefix)) acc)
+        pkg_prefixes []
+      |> List.sort (fun (nv1,n1,_) (nv2,n2,_) ->
+          (* Some pseudo-randomisation to avoid downloading all files from
+             the same host in a row *)
+          match compare (Hashtbl.hash (nv1,n1)) (Hashtbl.hash (nv2,n2)) with
+          | 0 -> compare (nv1,n1) (nv2,n2)
+          | n -> n)
+    in
+    let pools =
+      if jobs_per_host >= jobs then None else
+      let hosts =
+        List.fold_left (fun (i, hosts) (_,_,urlf) ->
+            i + 1,
+            OpamStd.String.Map.update (url_host (OpamFile.URL.url urlf))
+              (fun l -> i::l) [] hosts)
+          (0, OpamStd.String.Map.empty) archives
+        |> snd
+      in
+      (* The pools are cumulative: the global limit needs to be a pool of its
+         own *)
+      Some
+        ((List.mapi (fun i _ -> i) archives, jobs) ::
+         List.map (fun l -> l, jobs_per_host)
+           (OpamStd.String.Map.values hosts))
+    in
+    let journal =
+      if not recheck then None else
+      let verified = read_cache_journal cache_dir in
+      if not (OpamStd.String.Set.is_empty verified) then
+        OpamConsole.note
+          "Resuming an interrupted run: %d archives already verified"
+          (OpamStd.String.Set.cardinal verified);
+      OpamFilename.mkdir cache_dir;
+      Some (verified,
+            open_out_gen [Open_wronly; Open_creat; Open_append; Open_text]
+              0o644 (OpamFilename.to_string (cache_journal cache_dir)))
+    in
     let errors =
-      OpamParallel.reduce ~jobs
+      OpamStd.Exn.finally
+        (fun () -> Stdlib.Option.iter (fun (_, oc) -> close_out oc) journal)
+      @@ fun () ->
+      OpamParallel.reduce ~jobs ?pools
         ~nil:OpamPackage.Map.empty
-        ~merge:(OpamPackage.Map.union (fun a _ -> a))
-        ~command:(package_files_to_cache repo_root cache_dir cache_urls
-                    ~recheck ?link)
-        (List.sort (fun (nv1,_) (nv2,_) ->
-             (* Some pseudo-randomisation to avoid downloading all files from
-                the same host simultaneously *)
-             match compare (Hashtbl.hash nv1) (Hashtbl.hash nv2) with
-             | 0 -> compare nv1 nv2
-             | n -> n)
-            (OpamPackage.Map.bindings pkg_prefixes))
+        ~merge:(OpamPackage.Map.union (@))
+        ~command:(archive_to_cache cache_dir cache_urls ~recheck ?link ?journal)
+        archives
     in
+    if recheck then OpamFilename.remove (cache_journal cache_dir);
 
     let cache_dir_url = OpamFilename.remove_prefix_dir repo_root cache_dir in
     if not no_repo_update then
@@ -316,7 +402,7 @@ let cache_command cli =
   OpamArg.mk_command  ~cli OpamArg.cli_original command ~doc ~man
     Term.(const cmd $ global_options cli $
           cache_dir_arg $ no_repo_update_arg $ link_arg $ jobs_arg $
-          recheck_arg)
+          jobs_per_host_arg $ recheck_arg)
 
 let packages_with_prefixes repo_root packages =
   let pkgs_map = OpamRepository.packages_with_prefixes repo_root in
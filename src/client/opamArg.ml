@@ -124,6 +124,11 @@ let environment_variables =
       "STATUSLINE", cli_original, (fun v -> STATUSLINE (env_when v)),
       ("display a dynamic status line showing what's currently going on on \
         the terminal. (one of "^string_of_enum when_enum^")");
+      "TRACE", cli_from cli2_6, (fun v -> TRACE (env_string v)),
+      "$(i,file) records the timings of the main steps of opam, of its \
+       parallel jobs and of the commands it runs, and writes them to \
+       $(i,file) at exit, in the Chrome trace event format (that can be \
+       loaded in $(i,chrome://tracing) or $(i,https://ui.perfetto.dev)).";
       "USEOPENSSL", cli_between cli2_0 cli2_2, (fun _v -> OpamStd.Config.E.REMOVED),
       "force openssl use for hash computing.";
       "UTF8", cli_original, (fun v -> UTF8 (env_when_ext v)),
@@ -2050,6 +2050,53 @@ let check_installed ~build ~post ~recursive t atoms =
   in
   fst (loop OpamPackage.Name.Map.empty SeenSet.empty atoms)
 
+let solve_batch t requests =
+  let requested atoms =
+    OpamPackage.packages_of_names t.packages
+      (OpamPackage.Name.Set.of_list (List.map fst atoms))
+  in
+  let resolve =
+    if OpamStateConfig.(!r.build_test || !r.build_doc || !r.dev_setup) then
+      (* The dependencies then depend on the requested packages: the universe
+         can't be shared *)
+      (fun atoms request ->
+         OpamSolver.resolve
+           (OpamSwitchState.universe t Install ~requested:(requested atoms))
+           request)
+    else
+    let universe =
+      OpamSwitchState.universe t Install
+        ~requested:(requested (List.concat requests))
+    in
+    let resolve = OpamSolver.resolver universe in
+    fun atoms request -> resolve ~requested:(requested atoms) request
+  in
+  List.iter (fun atoms ->
+      let result =
+        match
+          List.filter (fun (n, _) -> not (OpamPackage.has_name t.packages n))
+            atoms
+        with
+        | (name, _) :: _ ->
+          "error", `String (Printf.sprintf "No package named %s"
+                              (OpamPackage.Name.to_string name))
+        | [] ->
+          match
+            resolve atoms (OpamSolver.request ~install:atoms ~all:atoms ())
+          with
+          | Success solution ->
+            "solution", OpamSolution.solution_to_json solution
+          | Conflicts cs ->
+            "conflicts", OpamSolution.conflicts_to_json t cs
+      in
+      let request =
+        `A (List.map (fun a -> `String (OpamFormula.short_string_of_atom a))
+              atoms)
+      in
+      OpamConsole.msg "%s\n"
+        (OpamJson.to_string ~minify:true (`O ["request", request; result])))
+    requests
+
 let assume_built_restrictions ?available_packages t atoms =
   let missing =
     check_installed ~build:false ~post:false ~recursive:false t atoms
@@ -86,6 +86,13 @@ val check_installed:
   build:bool -> post:bool -> recursive:bool -> rw switch_state -> atom list ->
   OpamPackage.Name.Set.t OpamPackage.Name.Map.t
 
+(** Solves each of the given installation requests in the given switch,
+    without applying them, and prints the results to stdout as they come, as
+    one JSON object per line. Unless the test, doc or dev-setup dependencies
+    are enabled, the universe is built and translated for the solver only once
+    for all the requests. *)
+val solve_batch: 'a switch_state -> atom list list -> unit
+
 (** Reinstall the given set of packages. *)
 val reinstall:
   rw switch_state -> ?assume_built:bool -> atom list -> rw switch_state
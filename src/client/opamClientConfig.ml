@@ -209,6 +209,9 @@ let search_files = ["findlib"]
 let opam_init ?root_dir ?strict ?solver =
   let open OpamStd.Option.Op in
 
+  (* start tracing before loading anything *)
+  Option.iter OpamTrace.enable (OpamCoreConfig.E.trace ());
+
   (* (i) get root dir *)
   let root_from, root = OpamStateConfig.opamroot_with_provenance ?root_dir () in
 
@@ -1745,9 +1745,20 @@ let env cli =
     apply_global_options cli global_options;
     if check then
       (OpamGlobalState.with_ `Lock_none @@ fun gt ->
-      OpamSwitchState.with_ `Lock_none gt @@ fun st ->
-      if not (OpamEnv.is_up_to_date ~skip:false st) then
-        OpamStd.Sys.exit_because `False)
+       let up_to_date =
+         match OpamStateConfig.get_switch_opt () with
+         | Some switch
+           when OpamFile.exists (OpamPath.Switch.environment gt.root switch)
+             && OpamSysPoll.os_family gt.global_variables <> Some "nixos" ->
+           (* The environment file is rewritten whenever the installed
+              packages change: no need to load the switch state *)
+           OpamEnv.is_up_to_date_switch ~skip:false gt.root switch
+         | _ ->
+           OpamSwitchState.with_ `Lock_none gt @@ fun st ->
+           OpamEnv.is_up_to_date ~skip:false st
+       in
+       if not up_to_date then
+         OpamStd.Sys.exit_because `False)
     else
     let shell = match shell with
       | Some s -> s
@@ -1853,12 +1864,91 @@ let install cli =
        the required system dependencies, without affecting the opam switch \
        state or installing opam packages."
   in
+  let batch =
+    mk_opt ~cli (cli_from cli2_6) ["batch"] "FILE"
+      "Don't install anything, but solve each of the requests read from \
+       $(i,FILE) (or from stdin if $(i,FILE) is $(b,-)) against the current \
+       switch, and print the results as one JSON object per line. Each \
+       non-empty line of $(i,FILE) not starting with $(b,#) is a \
+       whitespace-separated list of packages to install together, with the \
+       same syntax as the $(i,PACKAGES) arguments, but no local paths. Only \
+       the global and build options are taken into account, other options \
+       of $(b,install) are rejected. This is much \
+       faster than calling $(b,opam install --show-actions) for each request, \
+       since the switch state and the solver universe are loaded only once."
+      Arg.(some string) None
+  in
   let install
       global_options build_options add_to_roots deps_only ignore_conflicts
       restore destdir assume_built check recurse subpath depext_only formula
-      download_only atoms_or_locals () =
+      download_only batch atoms_or_locals () =
     apply_global_options cli global_options;
     apply_build_options cli build_options;
+    match batch with
+    | Some file ->
+      if atoms_or_locals <> [] || formula <> OpamFormula.Empty then
+        `Error (true, "option --batch can't be used with packages or \
+                       --formula")
+      else
+      let incompatible =
+        List.filter_map (fun (set, opt) -> if set then Some opt else None) [
+          add_to_roots <> None, "--set-root/--unset-root";
+          deps_only, "--deps-only";
+          ignore_conflicts, "--ignore-conflicts";
+          restore, "--restore";
+          destdir <> None, "--destdir";
+          assume_built, "--assume-built";
+          check, "--check";
+          recurse, "--recursive";
+          subpath <> None, "--subpath";
+          depext_only, "--depext-only";
+          download_only, "--download-only";
+        ]
+      in
+      if incompatible <> [] then
+        `Error (true, Printf.sprintf "option --batch can't be used with %s"
+                  (OpamStd.Format.pretty_list incompatible))
+      else
+      let read_lines ic =
+        let rec aux acc =
+          match input_line ic with
+          | l -> aux (l :: acc)
+          | exception End_of_file -> List.rev acc
+        in
+        aux []
+      in
+      let lines =
+        if file = "-" then read_lines stdin else
+        match open_in file with
+        | ic ->
+          OpamStd.Exn.finally (fun () -> close_in ic) @@ fun () ->
+          read_lines ic
+        | exception Sys_error msg ->
+          OpamConsole.error_and_exit `Bad_arguments "%s" msg
+      in
+      let blanks = Re.(compile (rep1 space)) in
+      let requests =
+        List.mapi (fun i l ->
+            match String.trim l with
+            | "" -> None
+            | l when l.[0] = '#' -> None
+            | l ->
+              Some (List.map (fun word ->
+                  match fst OpamArg.atom word with
+                  | `Ok atom -> atom
+                  | `Error msg ->
+                    OpamConsole.error_and_exit `Bad_arguments
+                      "%s, line %d: %s"
+                      (if file = "-" then "stdin" else file) (i + 1) msg)
+                  (Re.split blanks l)))
+          lines
+        |> List.filter_map (fun x -> x)
+      in
+      OpamGlobalState.with_ `Lock_none @@ fun gt ->
+      OpamSwitchState.with_ `Lock_none gt @@ fun st ->
+      OpamClient.solve_batch st requests;
+      `Ok ()
+    | None ->
     if atoms_or_locals = [] && not restore && formula = OpamFormula.Empty then
       `Error (true, "required argument PACKAGES is missing")
     else
@@ -1936,7 +2026,7 @@ let install cli =
     Term.(const install $global_options cli $build_options cli
           $add_to_roots $deps_only $ignore_conflicts $restore $destdir
           $assume_built cli $check $recurse cli $subpath cli $depext_only
-          $formula_flag cli $download_only $atom_or_local_list)
+          $formula_flag cli $download_only $batch $atom_or_local_list)
 
 (* REMOVE *)
 let remove_doc = "Remove a list of packages."
@@ -2821,6 +2911,20 @@ let switch cli =
        $(i,list-available)."
       Arg.(some (list string)) None
   in
+  let clone_from =
+    mk_opt ~cli (cli_from cli2_6) ["clone-from"] "SWITCH"
+      "When creating a switch, copy the installation of the existing switch \
+       $(i,SWITCH) instead of building the packages, with the same \
+       invariant, repositories and installed packages. Where the file system \
+       supports it, the files are copy-on-write clones and the copy is almost \
+       free. Text files referring to the location of $(i,SWITCH) are \
+       relocated, and the packages with binary files referring to it are \
+       rebuilt. Any file containing a NUL byte counts as binary: the \
+       compiler, and most packages built with it, record its location in \
+       their executables and compiled files, and will usually be rebuilt. The \
+       gain is then mainly for the packages that don't need compiling."
+      Arg.(some string) None
+  in
   let descr =
     mk_opt ~cli cli_original ["description"] "STRING"
       "Attach the given description to a switch when creating it. Use the \
@@ -2880,7 +2984,7 @@ let switch cli =
   let switch
       global_options build_options command print_short
       no_switch packages formula empty descr full freeze no_install deps_only repos
-      force no_action all
+      clone_from force no_action all
       d_alias_of d_no_autoinstall params () =
     if d_alias_of <> None then
       OpamConsole.warning
@@ -2981,6 +3085,48 @@ let switch cli =
           "Some compilers have been hidden (e.g. pre-releases). \
            If you want to display them, run: 'opam switch list-available --all'";
       `Ok ()
+    | Some `install, switch_arg::params when clone_from <> None ->
+      if params <> [] || packages <> None || formula <> None || empty then
+        `Error (true, "option --clone-from can't be used with a compiler, \
+                       --packages, --formula or --empty")
+      else
+      let src = OpamSwitch.of_string (Option.get clone_from) in
+      OpamGlobalState.with_ `Lock_write @@ fun gt ->
+      let src_config =
+        OpamFile.Switch_config.safe_read
+          (OpamPath.Switch.switch_config gt.root src)
+      in
+      let repos = match repos with
+        | Some _ -> repos
+        | None ->
+          Option.map (List.map OpamRepositoryName.to_string)
+            src_config.OpamFile.Switch_config.repos
+      in
+      with_repos_rt gt cli repos @@ fun (repos, rt) ->
+      let invariant =
+        OpamStd.Option.default OpamFormula.Empty
+          src_config.OpamFile.Switch_config.invariant
+      in
+      let synopsis =
+        OpamStd.Option.default src_config.OpamFile.Switch_config.synopsis descr
+      in
+      let (), st =
+        OpamSwitchCommand.create gt ~rt ~synopsis ?repos ~clone_from:src
+          ~update_config:(not no_switch)
+          ~invariant
+          (OpamSwitch.of_string switch_arg)
+        @@ fun st ->
+        let rebuild = Lazy.force st.reinstall in
+        let st =
+          if OpamPackage.Set.is_empty rebuild then st else
+            OpamClient.reinstall_t st ~assume_built:false
+              (OpamSolution.eq_atoms_of_packages rebuild)
+        in
+        OpamSwitchAction.write_selections st;
+        (), st
+      in
+      OpamSwitchState.drop st;
+      `Ok ()
     | Some `install, switch_arg::params ->
       OpamGlobalState.with_ `Lock_write @@ fun gt ->
       with_repos_rt gt cli repos @@ fun (repos, rt) ->
@@ -3232,7 +3378,8 @@ let switch cli =
           $print_short_flag cli cli_original
           $no_switch
           $packages $formula $empty $descr $full $freeze $no_install
-          $deps_only $repos $force $no_action $all $d_alias_of $d_no_autoinstall
+          $deps_only $repos $clone_from $force $no_action $all
+          $d_alias_of $d_no_autoinstall
           $params)
 
 (* PIN *)
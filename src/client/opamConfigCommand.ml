@@ -263,6 +263,7 @@ let  write_last_env_file gt updates =
   let updates = check_writeable updates in
   let temp_dir = OpamPath.last_env gt.root in
   let hash = OpamEnv.hash_env_updates updates in
+  let contents = OpamFile.Environment.write_to_string updates in
   let rec aux  n =
     (* The principal aim here is not to spam /tmp with gazillions of files, but
        also to be sure that the file present has the correct content. [n] is used
@@ -271,19 +272,25 @@ let  write_last_env_file gt updates =
     let trial = "env-" ^ hash ^ "-" ^ string_of_int n in
     let target = OpamFilename.Op.(temp_dir // trial) in
     if OpamFilename.exists target then
-      (* File already exists - check its content *)
-      let target_hash =
-        OpamFile.make target
-        |> OpamFile.Environment.read_opt
-        |> Option.map OpamEnv.hash_env_updates
+      (* File already exists - check its content. This is run on every shell
+         prompt by the hooks, so first try a plain comparison, before parsing
+         it (the file may have been written differently by another version of
+         opam) *)
+      let same_contents =
+        (try String.equal (OpamFilename.read target) contents
+         with e -> OpamStd.Exn.fatal e; false)
+        || (OpamFile.make target
+            |> OpamFile.Environment.read_opt
+            |> Option.map OpamEnv.hash_env_updates) = Some hash
       in
-      if target_hash = Some hash then Some target else
+      if same_contents then Some target else
         (* Content collision/corruption, so try with higher [n] *)
         aux (succ n)
     else
     try
       (* Environment files are written atomically *)
-      OpamFile.Environment.write (OpamFile.make target) updates;
+      OpamFilename.with_open_out_bin_atomic target
+        (fun oc -> output_string oc contents);
       (* File should now exist with the correct content *)
       aux n
     with e -> OpamStd.Exn.fatal e; None
@@ -1293,8 +1300,13 @@ let var_switch_raw gt v =
     in
     let rsc =
       if is_switch_defined_var switch_config v then
-        OpamPackageVar.resolve_switch_raw gt switch switch_config
-          (OpamVariable.Full.of_string v)
+        let full_var = OpamVariable.Full.of_string v in
+        match
+          OpamPackageVar.resolve_switch_raw gt switch switch_config full_var
+        with
+        | Some _ as c -> c
+        | None ->
+          OpamPackageVar.resolve_package_raw gt switch switch_config full_var
       else None
     in
     (match rsc with
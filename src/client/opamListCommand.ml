@@ -199,6 +199,43 @@ let rec value_strings value =
     List.fold_left (fun acc v -> SS.union acc (value_strings v.pelem))
       (value_strings v.pelem) vl.pelem
 
+(* Narrows down the packages of [base] that may match the pattern, using the
+   search indexes of the repositories. Packages whose definition doesn't come
+   unchanged from an indexed repository (e.g. pinned) are always included. *)
+let search_candidates st psel pat base =
+  match OpamSearchIndex.query_of_pattern ~glob:psel.glob pat with
+  | None -> None
+  | Some _ when psel.fields = [] -> None
+  | Some _ when not (List.for_all OpamSearchIndex.is_indexed psel.fields) ->
+    None
+  | Some query ->
+    let rt = st.switch_repos in
+    let repos = OpamSwitchState.repos_list st in
+    let hits = Hashtbl.create 7 in
+    let repo_hits repo_name =
+      try Hashtbl.find hits repo_name with Not_found ->
+        let h =
+          Option.map (fun index ->
+              List.fold_left (fun acc field ->
+                  match OpamSearchIndex.find index ~field query with
+                  | Some pkgs -> pkgs ++ acc
+                  | None -> acc)
+                OpamPackage.Set.empty psel.fields)
+            (OpamRepositoryState.search_index rt repo_name)
+        in
+        Hashtbl.add hits repo_name h;
+        h
+    in
+    Some (OpamPackage.Set.filter (fun nv ->
+        match OpamRepositoryState.find_package_opt rt repos nv,
+              OpamSwitchState.opam_opt st nv with
+        | Some (repo_name, repo_opam), Some opam when repo_opam == opam ->
+          (match repo_hits repo_name with
+           | Some pkgs -> OpamPackage.Set.mem nv pkgs
+           | None -> true)
+        | _ -> true)
+        base)
+
 let pattern_selector patterns =
   let name_patt =
     { default_pattern_selector with exact = true; fields = ["name"] }
@@ -332,6 +369,9 @@ let apply_selector ~base st = function
           "Unrecognised field in selection %s"
           (String.concat ", " psel.fields)
     in
+    let base =
+      OpamStd.Option.default base (search_candidates st psel pat base)
+    in
     OpamPackage.Set.filter
       (fun nv -> List.exists (OpamStd.String.Set.exists (Re.execp re))
           (content_strings nv))
@@ -503,8 +503,11 @@ and source_pin
        u.path <> target.path ||
        u.backend <> target.backend
      ) ->
-     OpamFilename.rmdir
-       (OpamPath.Switch.pinned_package st.switch_global.root st.switch name)
+     let srcdir =
+       OpamPath.Switch.pinned_package st.switch_global.root st.switch name
+     in
+     OpamFilename.rmdir srcdir;
+     OpamLocal.remove_manifest srcdir
    | _ -> ());
 
   let pin_version = version +! cur_version in
@@ -699,8 +702,11 @@ let unpin st names =
   log "unpin %a"
     (slog @@ OpamStd.List.concat_map " " OpamPackage.Name.to_string) names;
   List.fold_left (fun st name ->
-      OpamFilename.rmdir
-        (OpamPath.Switch.pinned_package st.switch_global.root st.switch name);
+      let srcdir =
+        OpamPath.Switch.pinned_package st.switch_global.root st.switch name
+      in
+      OpamFilename.rmdir srcdir;
+      OpamLocal.remove_manifest srcdir;
       OpamFilename.rmdir
         (OpamPath.Switch.Overlay.package
            st.switch_global.root st.switch name);
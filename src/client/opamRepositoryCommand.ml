@@ -105,7 +105,9 @@ let remove rt name =
     update_repos_config rt (OpamRepositoryName.Map.remove name rt.repositories)
   in
   OpamRepositoryState.Cache.save rt;
-  OpamFilename.rmdir (OpamRepositoryPath.root rt.repos_global.root name);
+  let repo_root = OpamRepositoryPath.root rt.repos_global.root name in
+  OpamFilename.rmdir repo_root;
+  OpamLocal.remove_manifest repo_root;
   OpamFilename.remove (OpamRepositoryPath.tar rt.repos_global.root name);
   rt
 
@@ -117,7 +119,9 @@ let set_url rt name url trust_anchors =
       OpamConsole.error_and_exit `Not_found "No repository %s found"
         (OpamRepositoryName.to_string name);
   in
-  OpamFilename.cleandir (OpamRepositoryPath.root rt.repos_global.root name);
+  let repo_root = OpamRepositoryPath.root rt.repos_global.root name in
+  OpamFilename.cleandir repo_root;
+  OpamLocal.remove_manifest repo_root;
   OpamFilename.remove (OpamRepositoryPath.tar rt.repos_global.root name);
   let repo = { repo with repo_url = url; repo_trust = trust_anchors; } in
   OpamRepositoryState.remove_from_repos_tmp  rt name;
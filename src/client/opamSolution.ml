@@ -263,27 +263,32 @@ module Json = struct
     in
     OpamJson.append "request" j
 
-  let output_solution t solution =
+  let conflicts t cs =
+    let causes, cycles =
+      OpamCudf.conflict_explanations
+        t.packages (OpamSwitchState.unavailable_reason t) cs
+    in
+    let causes = List.map OpamCudf.string_of_conflict causes in
+    let toj l = `A (List.map (fun s -> `String s) l) in
+    `O ((if cycles <> [] then ["cycles", toj cycles] else []) @
+        (if causes <> [] then ["causes", toj causes] else []))
+
+  let solution solution =
+    let action_graph = OpamSolver.get_atomic_action_graph solution in
+    let to_proceed =
+      PackageActionGraph.Topological.fold (fun a acc ->
+          PackageAction.to_json a :: acc
+        ) action_graph []
+    in
+    `A (List.rev to_proceed)
+
+  let output_solution t sol =
     if OpamClientConfig.(!r.json_out = None) then () else
-    match solution with
-    | Success solution ->
-      let action_graph = OpamSolver.get_atomic_action_graph solution in
-      let to_proceed =
-        PackageActionGraph.Topological.fold (fun a acc ->
-            PackageAction.to_json a :: acc
-          ) action_graph []
-      in
-      OpamJson.append "solution" (`A (List.rev to_proceed))
+    match sol with
+    | Success sol ->
+      OpamJson.append "solution" (solution sol)
     | Conflicts cs ->
-      let causes, cycles =
-        OpamCudf.conflict_explanations
-          t.packages (OpamSwitchState.unavailable_reason t) cs
-      in
-      let causes = List.map OpamCudf.string_of_conflict causes in
-      let toj l = `A (List.map (fun s -> `String s) l) in
-      OpamJson.append "conflicts"
-        (`O ((if cycles <> [] then ["cycles", toj cycles] else []) @
-             (if causes <> [] then ["causes", toj causes] else [])))
+      OpamJson.append "conflicts" (conflicts t cs)
 
   let exc e =
     let lmap f l = List.rev (List.rev_map f l) in
@@ -307,6 +312,9 @@ module Json = struct
 
 end
 
+let solution_to_json = Json.solution
+let conflicts_to_json = Json.conflicts
+
 (* Process the atomic actions in a graph in parallel, respecting graph order,
    and report to user. Takes a graph of atomic actions *)
 let parallel_apply t
@@ -350,8 +358,9 @@ let parallel_apply t
         (OpamPackage.names_of_packages remove_action_packages)
   in
 
-  (* We keep an imperative state up-to-date and flush it to disk as soon
-     as an operation terminates *)
+  (* We keep an imperative state up-to-date, and record its changes to disk as
+     soon as an operation terminates (see
+     [OpamSwitchAction.with_batched_writes]) *)
   let t_ref = ref t in
 
   (* only needed when --update-invariant is set. Use the configured invariant,
@@ -739,7 +748,15 @@ let parallel_apply t
              with [] | [_] -> None | l -> Some (l,1))
           same_inplace_source
       in
+      let batched_writes f =
+        (* Rewriting the state files after each action only gets costly with
+           many actions *)
+        if List.length installs_removes > 10 then
+          OpamSwitchAction.with_batched_writes t_ref f
+        else f ()
+      in
       let results =
+        batched_writes @@ fun () ->
         PackageActionGraph.Parallel.map
           ~jobs:(Lazy.force OpamStateConfig.(!r.jobs))
           ~command:job
@@ -63,6 +63,14 @@ val resolve_and_apply:
   atom request ->
   rw switch_state * (solution_result, OpamCudf.conflict) result
 
+(** The atomic actions of the given solution, in the format used for the
+    ["solution"] field of the JSON output *)
+val solution_to_json: OpamSolver.solution -> OpamJson.t
+
+(** The explanations of the given conflicts, in the format used for the
+    ["conflicts"] field of the JSON output *)
+val conflicts_to_json: 'a switch_state -> OpamCudf.conflict -> OpamJson.t
+
 (** Raise an error if no solution is found or in case of error. Unless [quiet]
     is set, print a message indicating that nothing was done on an empty
     solution. *)
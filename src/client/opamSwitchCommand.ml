@@ -288,8 +288,114 @@ let install_compiler
   OpamSwitchAction.write_selections t;
   t
 
+(* Copies the installation of switch [src] to the new, empty [switch], making
+   copy-on-write clones of the files where the file system supports it. The
+   files recorded in the [.changes] of the installed packages that mention the
+   prefix of [src] are relocated if they are text files, and so are the
+   symbolic links pointing into it; the packages with binary files mentioning
+   it are marked for reinstallation. Any file containing a NUL byte counts as
+   binary: compilers usually record their prefix in their executables and
+   compiled objects, so most packages depending on one get rebuilt. *)
+let clone_switch_files gt rt ~src switch =
+  log "clone switch %a to %a"
+    (slog OpamSwitch.to_string) src (slog OpamSwitch.to_string) switch;
+  let root = gt.root in
+  let src_st = OpamSwitchState.load `Lock_read gt rt src in
+  let module C = OpamFile.Switch_config in
+  let src_prefix = OpamPath.Switch.root root src in
+  let prefix = OpamPath.Switch.root root switch in
+  let clone_dir dir =
+    let src = dir root src in
+    if OpamFilename.exists_dir src then
+      OpamFilename.clone_dir ~src ~dst:(dir root switch) ()
+  in
+  OpamFilename.clone_dir ~except:[OpamPath.Switch.meta_dirname]
+    ~src:src_prefix ~dst:prefix ();
+  List.iter clone_dir OpamPath.Switch.[
+      install_dir; config_dir; installed_opams; Overlay.dir; sources_dir;
+    ];
+  OpamFilename.remove (OpamPath.Switch.installed_opams_cache root switch);
+  let switch_config =
+    OpamFile.Switch_config.read (OpamPath.Switch.switch_config root switch)
+  in
+  OpamSwitchAction.install_switch_config root switch
+    { switch_config with
+      C.variables = src_st.switch_config.C.variables;
+      wrappers = src_st.switch_config.C.wrappers;
+      env = src_st.switch_config.C.env;
+      depext_bypass = src_st.switch_config.C.depext_bypass };
+  let src_pfx = OpamFilename.Dir.to_string src_prefix in
+  let pfx = OpamFilename.Dir.to_string prefix in
+  (* The prefix must not be followed by a character that could continue the
+     file name, so that e.g. the prefix of a switch [foo-bar] is left alone
+     when cloning [foo]. The character after it is matched, and kept. *)
+  let relocate_re =
+    Re.(compile @@ seq [
+        str src_pfx;
+        alt [group (compl [alnum; set "-_.+~@%#"]); eos];
+      ])
+  in
+  let relocate_path s =
+    Re.replace relocate_re s ~f:(fun g ->
+        if Re.Group.test g 1 then pfx ^ Re.Group.get g 1 else pfx)
+  in
+  let relocate file =
+    match (Unix.lstat file).Unix.st_kind with
+    | Unix.S_REG ->
+      let contents = OpamSystem.read file in
+      if not (Re.execp relocate_re contents) then `Unchanged
+      else if String.contains contents '\000' then `Binary
+      else
+        (OpamSystem.write file (relocate_path contents);
+         `Relocated)
+    | Unix.S_LNK ->
+      let target = Unix.readlink file in
+      if target = src_pfx ||
+         OpamCompat.String.starts_with ~prefix:(src_pfx ^ Filename.dir_sep)
+           target
+      then
+        let len = String.length src_pfx in
+        OpamSystem.link
+          (pfx ^ String.sub target len (String.length target - len)) file;
+        `Relocated
+      else `Unchanged
+    | _ | exception Unix.Unix_error _ -> `Unchanged
+  in
+  let to_rebuild =
+    OpamPackage.Set.filter (fun nv ->
+        let changes_file = OpamPath.Switch.changes root switch nv.name in
+        let changes = OpamFile.Changes.safe_read changes_file in
+        let binary =
+          OpamStd.String.Map.fold (fun file change binary ->
+              match change with
+              | OpamDirTrack.(Added _ | Contents_changed _ | Kind_changed _) ->
+                relocate (Filename.concat pfx file) = `Binary || binary
+              | OpamDirTrack.(Removed | Perm_changed _) -> binary)
+            changes false
+        in
+        (* The digests of the cloned files include their modification time *)
+        OpamFile.Changes.write changes_file
+          (OpamDirTrack.update prefix changes);
+        binary)
+      src_st.installed
+  in
+  List.iter (fun f -> ignore (relocate (OpamFilename.to_string f)))
+    (OpamFilename.files (OpamPath.Switch.config_dir root switch));
+  OpamFile.SwitchSelections.write (OpamPath.Switch.selections root switch)
+    (OpamSwitchState.selections src_st);
+  OpamFile.PkgList.write (OpamPath.Switch.reinstall root switch)
+    (Lazy.force src_st.reinstall ++ to_rebuild);
+  if not (OpamPackage.Set.is_empty to_rebuild) then
+    OpamConsole.note
+      "The following packages refer to the location of switch %s and will be \
+       rebuilt: %s"
+      (OpamSwitch.to_string src)
+      (OpamStd.List.concat_map " " OpamPackage.to_string
+         (OpamPackage.Set.elements to_rebuild));
+  OpamSwitchState.drop src_st
+
 let create
-    gt ~rt ?synopsis ?repos ~update_config ~invariant switch post =
+    gt ~rt ?synopsis ?repos ?clone_from ~update_config ~invariant switch post =
   let update_config = update_config && not (OpamSwitch.is_external switch) in
   let comp_dir = OpamPath.Switch.root gt.root switch in
   let simulate = OpamStateConfig.(!r.dryrun) || OpamClientConfig.(!r.show) in
@@ -301,12 +407,32 @@ let create
     OpamConsole.error_and_exit `Bad_arguments
       "Directory %S already exists, please choose a different name"
       (OpamFilename.Dir.to_string comp_dir);
+  Option.iter (fun src ->
+      if not (OpamGlobalState.switch_exists gt src) then
+        OpamConsole.error_and_exit `Not_found
+          "No switch %s is currently installed, it can't be cloned"
+          (OpamSwitch.to_string src);
+      let src_config =
+        OpamFile.Switch_config.safe_read
+          (OpamPath.Switch.switch_config gt.root src)
+      in
+      if src_config.OpamFile.Switch_config.paths <> [] then
+        OpamConsole.error_and_exit `Bad_arguments
+          "Switch %s has custom installation paths and can't be cloned"
+          (OpamSwitch.to_string src))
+    clone_from;
   let gt, st =
     if not simulate then
       let gt =
         OpamSwitchAction.create_empty_switch gt ?synopsis ?repos ~invariant
           switch
       in
+      (try
+         Option.iter (fun src -> clone_switch_files gt rt ~src switch)
+           clone_from
+       with e ->
+         OpamStd.Exn.finalise e @@ fun () ->
+         ignore (clear_switch gt switch));
       let rt =
         ({ rt with repos_global = (gt :> unlocked global_state)  }
          :> unlocked repos_state)
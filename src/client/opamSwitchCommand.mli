@@ -20,12 +20,20 @@ open OpamStateTypes
 
     [post] can be used to run guarded operations after the switch creation
     (cleanup will be proposed to the user if they fail). You probably want to
-    call [install_compiler] there. *)
+    call [install_compiler] there.
+
+    With [clone_from], the installation of the given switch is copied to the
+    new switch before it is loaded, cloning the files where the file system
+    supports it (see {!OpamSystem.clone_file}). Text files of the installed
+    packages referring to the prefix of the cloned switch are relocated, and
+    the packages with binary files referring to it are marked for
+    reinstallation, which is up to [post]. *)
 val create:
   rw global_state ->
   rt:'a repos_state ->
   ?synopsis:string ->
   ?repos:repository_name list ->
+  ?clone_from:switch ->
   update_config:bool ->
   invariant:formula ->
   switch ->
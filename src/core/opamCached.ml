@@ -31,6 +31,9 @@ end = struct
 
   type t = X.t
 
+  let load_span = X.name ^ " cache load"
+  let save_span = X.name ^ " cache save"
+
   let check_marshaled_file fd =
     try
     let ic = Unix.in_channel_of_descr fd in
@@ -67,6 +70,7 @@ end = struct
     OpamStd.Option.Op.(check_marshaled_file fd >>= f)
 
   let load cache_file =
+    OpamTrace.span ~cat:"cache" load_span @@ fun () ->
     match OpamFilename.opt_file cache_file with
     | Some file ->
         let r =
@@ -85,6 +89,7 @@ end = struct
       log "Running in safe mode, not upgrading the %s cache" X.name
     else
     try
+      OpamTrace.span ~cat:"cache" save_span @@ fun () ->
       let chrono = OpamConsole.timer () in
       OpamFilename.with_flock `Lock_write cache_file @@ fun fd ->
       log "Writing the %s cache to %s ..."
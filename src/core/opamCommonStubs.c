@@ -23,6 +23,17 @@
 
 #include <fcntl.h>
 #include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#if defined(__linux__)
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#elif defined(__APPLE__)
+#include <sys/attr.h>
+#include <sys/clonefile.h>
+#endif
 
 #else
 
@@ -71,7 +82,153 @@ CAMLprim value opam_nproc(value _unit) {
 #endif
 }
 
+static value opam_dir_entry(value tail, value name, int is_dir)
+{
+  CAMLparam2(tail, name);
+  CAMLlocal2(entry, cell);
+
+  entry = caml_alloc_tuple(2);
+  Store_field(entry, 0, name);
+  Store_field(entry, 1, Val_bool(is_dir));
+  cell = caml_alloc_small(2, Tag_cons);
+  Field(cell, 0) = entry;
+  Field(cell, 1) = tail;
+  CAMLreturn(cell);
+}
+
+/* Lists a directory without a stat per entry, where the system directory
+   listing already tells whether each entry is a directory */
+CAMLprim value opam_readdir_kinds(value path)
+{
+  CAMLparam1(path);
+  CAMLlocal2(res, name);
+#ifdef _WIN32
+  WIN32_FIND_DATAW data;
+  HANDLE h;
+  wchar_t *p, *pattern;
+  size_t len;
+
+  caml_unix_check_path(path, "FindFirstFileExW");
+  p = caml_stat_strdup_to_utf16(String_val(path));
+  len = wcslen(p);
+  pattern = caml_stat_alloc((len + 3) * sizeof(wchar_t));
+  wcscpy(pattern, p);
+  caml_stat_free(p);
+  if (len > 0 && pattern[len - 1] != L'\\' && pattern[len - 1] != L'/')
+    wcscat(pattern, L"\\");
+  wcscat(pattern, L"*");
+  h = FindFirstFileExW(pattern, FindExInfoBasic, &data, FindExSearchNameMatch,
+                       NULL, 0);
+  caml_stat_free(pattern);
+  if (h == INVALID_HANDLE_VALUE) {
+    win32_maperr(GetLastError());
+    caml_uerror("FindFirstFileExW", path);
+  }
+  res = Val_emptylist;
+  do {
+    const wchar_t *n = data.cFileName;
+    if (n[0] == L'.' && (n[1] == 0 || (n[1] == L'.' && n[2] == 0)))
+      continue;
+    name = caml_copy_string_of_utf16(n);
+    /* Links to directories carry the directory attribute too */
+    res = opam_dir_entry(res, name,
+                         (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0);
+  } while (FindNextFileW(h, &data));
+  FindClose(h);
+#else
+  DIR *d;
+  struct dirent *e;
+  struct stat st;
+  int is_dir, err;
+
+  caml_unix_check_path(path, "opendir");
+  d = opendir(String_val(path));
+  if (d == NULL) caml_uerror("opendir", path);
+  res = Val_emptylist;
+  for (;;) {
+    errno = 0;
+    e = readdir(d);
+    if (e == NULL) break;
+    if (e->d_name[0] == '.' &&
+        (e->d_name[1] == 0 || (e->d_name[1] == '.' && e->d_name[2] == 0)))
+      continue;
+#ifdef DT_DIR
+    if (e->d_type == DT_DIR)
+      is_dir = 1;
+    else if (e->d_type == DT_REG)
+      is_dir = 0;
+    else
+#endif
+    /* Links and unknown types: follow them, and skip dangling entries */
+    if (fstatat(dirfd(d), e->d_name, &st, 0) == 0)
+      is_dir = S_ISDIR(st.st_mode);
+    else
+      continue;
+    name = caml_copy_string(e->d_name);
+    res = opam_dir_entry(res, name, is_dir);
+  }
+  err = errno;
+  closedir(d);
+  if (err != 0) {
+    errno = err;
+    caml_uerror("readdir", path);
+  }
+#endif
+  CAMLreturn(res);
+}
+
+/* Makes [dst], which must not exist, a copy-on-write clone of the regular file
+   [src] (FICLONE on Linux, clonefile on macOS). Returns false, leaving nothing
+   behind, when the file system or platform doesn't support it, so that the
+   caller can fall back to a plain copy. */
+CAMLprim value opam_clone_file(value src, value dst)
+{
+  CAMLparam2(src, dst);
+  int ok = 0;
+#if defined(__linux__) && defined(FICLONE)
+  char *s, *d;
+  int sfd, dfd;
+  struct stat st;
+
+  caml_unix_check_path(src, "ioctl");
+  caml_unix_check_path(dst, "ioctl");
+  s = caml_stat_strdup(String_val(src));
+  d = caml_stat_strdup(String_val(dst));
+  caml_enter_blocking_section();
+  sfd = open(s, O_RDONLY | O_CLOEXEC);
+  if (sfd >= 0) {
+    if (fstat(sfd, &st) == 0 && S_ISREG(st.st_mode)) {
+      dfd = open(d, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+      if (dfd >= 0) {
+        ok = ioctl(dfd, FICLONE, sfd) == 0
+          && fchmod(dfd, st.st_mode & 07777) == 0;
+        close(dfd);
+        if (!ok) unlink(d);
+      }
+    }
+    close(sfd);
+  }
+  caml_leave_blocking_section();
+  caml_stat_free(s);
+  caml_stat_free(d);
+#elif defined(__APPLE__)
+  char *s, *d;
+
+  caml_unix_check_path(src, "clonefile");
+  caml_unix_check_path(dst, "clonefile");
+  s = caml_stat_strdup(String_val(src));
+  d = caml_stat_strdup(String_val(dst));
+  caml_enter_blocking_section();
+  ok = clonefile(s, d, CLONE_NOFOLLOW) == 0;
+  caml_leave_blocking_section();
+  caml_stat_free(s);
+  caml_stat_free(d);
+#endif
+  CAMLreturn(Val_bool(ok));
+}
+
 /* This is done here as it simplifies the dune file */
+#include "opamSHA.c"
 #ifdef _WIN32
 #include "opamInject.c"
 #include "opamWindows.c"
@@ -0,0 +1,48 @@
+(**************************************************************************)
+(*                                                                        *)
+(*    Copyright 2026 OCamlPro                                             *)
+(*                                                                        *)
+(*  All rights reserved. This file is distributed under the terms of the  *)
+(*  GNU Lesser General Public License version 2.1, with the special       *)
+(*  exception on linking described in the file LICENSE.                   *)
+(*                                                                        *)
+(**************************************************************************)
+
+(** Pure OCaml computations run alongside the main program. With OCaml 5, they
+    are run by a fixed set of worker domains; with earlier versions, they are
+    computed synchronously upon {!spawn}.
+
+    The computations must not share mutable state with the rest of the
+    program: in particular, they must not print, log, record traces (see
+    {!OpamTrace}), or use the global configuration. They must not wait for other computations either, as
+    these may be queued behind them. *)
+
+(** A computation returning ['a] *)
+type 'a t
+
+(** The maximum number of computations that should be running at a given time
+    (not counting the main program). [0] means that they can't be run in
+    parallel, and that there is no point in spawning them. *)
+val max_parallel: int
+
+(** [spawn f] starts computing [f ()] *)
+val spawn: (unit -> 'a) -> 'a t
+
+(** Returns [Some result] if the computation is finished, [None] otherwise.
+    Exceptions raised by the computation are re-raised. *)
+val poll: 'a t -> 'a option
+
+(** Waits for the computation to finish, and returns its result. Exceptions
+    raised by the computation are re-raised. *)
+val join: 'a t -> 'a
+
+(** [await ready] returns [ready ()] if it isn't [None], and otherwise blocks
+    until a computation finishes, and returns [None]. It must only be called
+    while computations are pending. With [wake_on_signal], it also returns
+    when the given signal is received: [ready] is called after the handler
+    is installed, so that it can check for the events notified by the signal
+    without missing any. With [wake_on_fds], it also returns when one of the
+    given file descriptors can be read from (not on Windows). *)
+val await:
+  ?wake_on_signal:int -> ?wake_on_fds:Unix.file_descr list ->
+  (unit -> 'a option) -> 'a option
@@ -0,0 +1,25 @@
+(**************************************************************************)
+(*                                                                        *)
+(*    Copyright 2026 OCamlPro                                             *)
+(*                                                                        *)
+(*  All rights reserved. This file is distributed under the terms of the  *)
+(*  GNU Lesser General Public License version 2.1, with the special       *)
+(*  exception on linking described in the file LICENSE.                   *)
+(*                                                                        *)
+(**************************************************************************)
+
+type 'a t = ('a, exn) result
+
+let max_parallel = 0
+
+let spawn f = try Ok (f ()) with e -> Error e
+
+let poll = function
+  | Ok x -> Some x
+  | Error e -> raise e
+
+let join = function
+  | Ok x -> x
+  | Error e -> raise e
+
+let await ?wake_on_signal:_ ?wake_on_fds:_ ready = ready ()
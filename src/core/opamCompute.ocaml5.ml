@@ -0,0 +1,139 @@
+(**************************************************************************)
+(*                                                                        *)
+(*    Copyright 2026 OCamlPro                                             *)
+(*                                                                        *)
+(*  All rights reserved. This file is distributed under the terms of the  *)
+(*  GNU Lesser General Public License version 2.1, with the special       *)
+(*  exception on linking described in the file LICENSE.                   *)
+(*                                                                        *)
+(**************************************************************************)
+
+(* Computations are queued, and run by a fixed set of worker domains, started
+   on demand up to [max_parallel]. Their completion is broadcast on
+   [finished], and on Unix also notified through a pipe, which {!await} can
+   wait on along with signals. *)
+
+type 'a t = ('a, exn) result option Atomic.t
+
+let max_parallel = max 0 (Domain.recommended_domain_count () - 1)
+
+let mutex = Mutex.create ()
+let work = Condition.create () (* signalled when a computation is queued *)
+let finished = Condition.create () (* broadcast when one is done *)
+let queue : (unit -> unit) Queue.t = Queue.create ()
+let workers = ref 0
+let idle = ref 0
+let completions = ref 0
+let awaited = ref 0 (* value of [completions] at the last [await] *)
+
+let notify_pipe =
+  lazy
+    (if Sys.win32 then None else
+     let r, w = Unix.pipe ~cloexec:true () in
+     Unix.set_nonblock r;
+     Unix.set_nonblock w;
+     Some (r, w))
+
+let notify () =
+  match Lazy.force notify_pipe with
+  | None -> ()
+  | Some (_, w) ->
+    try ignore (Unix.single_write w (Bytes.make 1 '\000') 0 1)
+    with Unix.Unix_error _ -> () (* pipe full: a wake up is pending anyway *)
+
+let complete result r =
+  Mutex.lock mutex;
+  Atomic.set result (Some r);
+  incr completions;
+  Condition.broadcast finished;
+  Mutex.unlock mutex;
+  notify ()
+
+let rec worker () =
+  Mutex.lock mutex;
+  incr idle;
+  while Queue.is_empty queue do Condition.wait work mutex done;
+  decr idle;
+  let task = Queue.pop queue in
+  Mutex.unlock mutex;
+  task ();
+  worker ()
+
+let spawn f =
+  let result = Atomic.make None in
+  let task () = complete result (try Ok (f ()) with e -> Error e) in
+  if max_parallel = 0 then task () else (
+    (* forced from the main domain, before any worker may use it *)
+    ignore (Lazy.force notify_pipe);
+    Mutex.lock mutex;
+    Queue.push task queue;
+    if Queue.length queue > !idle && !workers < max_parallel then
+      (incr workers; ignore (Domain.spawn worker));
+    Condition.signal work;
+    Mutex.unlock mutex
+  );
+  result
+
+let poll t =
+  match Atomic.get t with
+  | None -> None
+  | Some (Ok x) -> Some x
+  | Some (Error e) -> raise e
+
+let join t =
+  if Option.is_none (Atomic.get t) then (
+    Mutex.lock mutex;
+    while Option.is_none (Atomic.get t) do Condition.wait finished mutex done;
+    Mutex.unlock mutex
+  );
+  match poll t with
+  | Some x -> x
+  | None -> assert false
+
+let await ?wake_on_signal ?(wake_on_fds=[]) ready =
+  match Lazy.force notify_pipe, wake_on_signal with
+  | Some (r, _), _ ->
+    let restore =
+      match wake_on_signal with
+      | None -> ignore
+      | Some s ->
+        let prev = Sys.signal s (Sys.Signal_handle (fun _ -> notify ())) in
+        fun () -> Sys.set_signal s prev
+    in
+    OpamStd.Exn.finally restore (fun () ->
+        match ready () with
+        | Some _ as x -> x
+        | None ->
+          (try ignore (Unix.select (r :: wake_on_fds) [] [] (-1.))
+           with Unix.Unix_error (Unix.EINTR, _, _) -> ());
+          let buf = Bytes.create 64 in
+          let rec drain () =
+            match Unix.read r buf 0 (Bytes.length buf) with
+            | 0 -> ()
+            | _ -> drain ()
+            | exception Unix.Unix_error _ -> ()
+          in
+          drain ();
+          None)
+  | None, None ->
+    (match ready () with
+     | Some _ as x -> x
+     | None ->
+       Mutex.lock mutex;
+       while !completions = !awaited do Condition.wait finished mutex done;
+       awaited := !completions;
+       Mutex.unlock mutex;
+       None)
+  | None, Some _ ->
+    (* Signals can't interrupt the wait here: poll instead *)
+    let rec aux () =
+      match ready () with
+      | Some _ as x -> x
+      | None ->
+        Mutex.lock mutex;
+        let completed = !completions <> !awaited in
+        awaited := !completions;
+        Mutex.unlock mutex;
+        if completed then None else (Unix.sleepf 0.002; aux ())
+    in
+    aux ()
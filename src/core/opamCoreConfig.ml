@@ -24,6 +24,7 @@ module E = struct
     | PRECISETRACKING of bool option
     | SAFE of bool option
     | STATUSLINE of OpamStd.Config.when_ option
+    | TRACE of string option
     | UTF8 of OpamStd.Config.when_ext option
     | UTF8MSGS of bool option
     | VERBOSE of OpamStd.Config.level option
@@ -43,6 +44,7 @@ module E = struct
   let precisetracking = value (function PRECISETRACKING b -> b | _ -> None)
   let safe = value (function SAFE b -> b | _ -> None)
   let statusline = value (function STATUSLINE c -> c | _ -> None)
+  let trace = value (function TRACE s -> s | _ -> None)
   let utf8 = value (function UTF8 c -> c | _ -> None)
   let utf8msgs = value (function UTF8MSGS b -> b | _ -> None)
   let verbose = value (function VERBOSE l -> l | _ -> None)
@@ -304,6 +304,8 @@ let copy_dir_t f ~src ~dst =
 
 let copy_dir = copy_dir_t OpamSystem.copy_dir
 let copy_dir_except_vcs = copy_dir_t OpamSystem.copy_dir_except_vcs
+let clone_dir ?except ~src ~dst () =
+  copy_dir_t (OpamSystem.clone_dir ?except) ~src ~dst
 
 let install ?warning ?exec ~src ~dst () =
   if src <> dst then OpamSystem.install ?warning ?exec (to_string src) (to_string dst)
@@ -471,6 +473,8 @@ let patch ~allow_unclean patch_source dir =
 
 let flock flag ?dontblock file = OpamSystem.flock flag ?dontblock (to_string file)
 
+let try_flock flag file = OpamSystem.try_flock flag (to_string file)
+
 let with_flock flag ?dontblock file f =
   let lock = OpamSystem.flock flag ?dontblock (to_string file) in
   try
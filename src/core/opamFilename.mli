@@ -78,6 +78,11 @@ val copy_dir: src:Dir.t -> dst:Dir.t -> unit
     ([.git], [.hg], [_darcs]) *)
 val copy_dir_except_vcs : src:Dir.t -> dst:Dir.t -> unit
 
+(** Same as [copy_dir], but makes the files copy-on-write clones of the
+    originals where the file system supports it. The entries of [src] named in
+    [except] are skipped (but not those of its sub-directories). *)
+val clone_dir: ?except:string list -> src:Dir.t -> dst:Dir.t -> unit -> unit
+
 (** Link a directory *)
 val link_dir: target:Dir.t -> link:Dir.t -> unit
 
@@ -311,6 +316,9 @@ val find_in_parents: (Dir.t -> bool) ->  Dir.t -> Dir.t option
     possible *)
 val flock: [< OpamSystem.lock_flag ] -> ?dontblock:bool -> t -> OpamSystem.lock
 
+(** See {!OpamSystem.try_flock} *)
+val try_flock: [< OpamSystem.actual_lock_flag ] -> t -> OpamSystem.lock option
+
 (** Calls [f] while holding a lock file. Ensures the lock is properly released
     on [f] exit. [f] is passed the file_descr of the lock.
     @raise OpamSystem.Locked if [dontblock] is set and the lock
@@ -117,6 +117,24 @@ let mismatch f (kind, _ as h) =
   let hf = compute ~kind f in
   if hf = h then None else Some hf
 
+let compute_all kinds file =
+  let has k = List.exists (equal_kind k) kinds in
+  let md5, sha256, sha512 =
+    OpamStubs.hash_file file
+      ~md5:(has `MD5) ~sha256:(has `SHA256) ~sha512:(has `SHA512)
+  in
+  List.map (function
+      | `MD5 -> make `MD5 md5
+      | `SHA256 -> make `SHA256 sha256
+      | `SHA512 -> make `SHA512 sha512)
+    kinds
+
+let mismatch_all f hashes =
+  let found = compute_all (List.map kind hashes) f in
+  OpamStd.List.find_map_opt (fun (hf, h) ->
+      if equal hf h then None else Some (hf, h))
+    (List.combine found hashes)
+
 module O = struct
   type _t = t
   type t = _t
@@ -53,8 +53,17 @@ val check_string: string -> t -> bool
     [None] in case of match *)
 val mismatch: string -> t -> t option
 
+(** Like {!mismatch}, for all the given hashes at once, but reading the file
+    only once. Returns the first mismatch found, as the pair of the actual hash
+    of the file and the expected one. *)
+val mismatch_all: string -> t list -> (t * t) option
+
 (** Compute hash of the given file *)
 val compute: ?kind:kind -> string -> t
 
+(** Compute the hashes of the given kinds for the given file, in a single read
+    of the file *)
+val compute_all: kind list -> string -> t list
+
 (** Compute the hash of the given string *)
 val compute_from_string: ?kind:kind -> string -> t
@@ -79,8 +79,6 @@ module Make (G : G) = struct
   exception Errors of G.V.t list * (G.V.t * exn) list * G.V.t list
   exception Cyclic of V.t list list
 
-  open S.Op
-
   (* Returns a map (node -> return value) *)
   let aux_map ~jobs ~command ?(dry_run=false) ?(pools=[]) g =
     log "Iterate over %a task(s) with %d process(es)"
@@ -88,19 +86,29 @@ module Make (G : G) = struct
 
     let njobs = G.nb_vertex g in
 
-    let all_jobs = G.fold_vertex S.add g S.empty in
-
-    let pools =
-      let defined =
-        List.map (fun (elts, jobs) -> S.of_list elts, jobs)
-          pools
+    (* Pools are numbered from 1, [0] being the default pool of the nodes that
+       are in no other pool. [pool_sizes] maps them to their number of slots,
+       and [pools_of] maps every node to the pools it belongs to. *)
+    let pool_sizes, pools_of =
+      let defined = List.mapi (fun i (elts, jobs) -> i + 1, elts, jobs) pools in
+      let pools_of =
+        List.fold_left (fun acc (i, elts, _) ->
+            List.fold_left (fun acc n ->
+                M.update n (fun l -> if List.mem i l then l else i :: l) []
+                  acc)
+              acc elts)
+          M.empty defined
       in
-      let default =
-        List.fold_left (fun acc (pool, _) -> acc -- pool)
-          all_jobs defined, jobs
+      let pools_of =
+        G.fold_vertex (fun n acc ->
+            if M.mem n acc then acc else M.add n [0] acc)
+          g pools_of
       in
-      default :: defined
+      List.fold_left (fun acc (i, _, jobs) -> OpamStd.IntMap.add i jobs acc)
+        (OpamStd.IntMap.singleton 0 jobs) defined,
+      pools_of
     in
+    let pools_of n = M.find n pools_of in
 
     let gc_compacted = ref false in
 
@@ -141,62 +149,52 @@ module Make (G : G) = struct
       if texts <> [] then OpamConsole.status_line "%s" (String.concat " " texts)
     in
 
-    (* nslots is the number of free slots *)
+    (* [ready] holds the nodes whose predecessors are done. When one of them
+       is found to be in a full pool, it is moved to the [blocked] nodes of
+       that pool, which are only looked at again when a slot is freed in it:
+       finishing a job thus only costs in proportion to its pools and
+       successors, not to the size of the pools. *)
     let rec loop
-        (nslots: (S.t * int) list) (* number of free slots *)
+        (nslots: int OpamStd.IntMap.t) (* number of free slots, per pool *)
         (results: 'b M.t)
         (running: (OpamProcess.t * 'a * string option) M.t)
+        (computing: (unit -> 'b OpamProcess.job) OpamCompute.t M.t)
         (ready: S.t)
+        (blocked: S.t OpamStd.IntMap.t)
       =
-      let get_slots nslots n =
-        List.filter (fun (pool, _) -> S.mem n pool) nslots
+      let full_pool nslots n =
+        List.find_opt (fun p -> OpamStd.IntMap.find p nslots <= 0)
+          (pools_of n)
       in
       let take_slot nslots n =
-        List.map (fun (pool, slots) ->
-            if S.mem n pool then (assert (slots > 0); pool, slots - 1)
-            else pool, slots)
-          nslots
+        List.fold_left (fun nslots p ->
+            OpamStd.IntMap.update p (fun slots -> assert (slots > 0); slots - 1)
+              0 nslots)
+          nslots (pools_of n)
       in
       let release_slot nslots n =
-        List.map (fun (pool, slots) ->
-            if S.mem n pool then (pool, slots + 1)
-            else pool, slots)
-          nslots
+        List.fold_left (fun nslots p ->
+            OpamStd.IntMap.update p succ 0 nslots)
+          nslots (pools_of n)
       in
-      let run_seq_command nslots ready n = function
-        | Done r ->
-          log "Job %a finished" (slog (string_of_int @* V.hash)) n;
-          let results = M.add n r results in
-          let running = M.remove n running in
-          if not (M.is_empty running) then
-            print_status (M.cardinal results) running;
-          let nslots = release_slot nslots n in
-          let new_ready =
-            S.filter
-              (fun n ->
-                 not (M.mem n running) &&
-                 not (M.mem n results) &&
-                 List.for_all (fun n -> M.mem n results) (G.pred g n) &&
-                 List.for_all (fun (_, slots) -> slots > 0)
-                   (get_slots nslots n))
-              (List.fold_left (fun acc (pool, slots) ->
-                   if slots = 1 then acc ++ pool else acc)
-                  (S.of_list (G.succ g n))
-                  (get_slots nslots n))
-          in
-          loop nslots results running (ready ++ new_ready)
-        | Run (cmd, cont) ->
-          log "Next task in job %a: %a" (slog (string_of_int @* V.hash)) n
-            (slog OpamProcess.string_of_command) cmd;
-          let p =
-            if dry_run then OpamProcess.dry_run_background cmd
-            else OpamProcess.run_background cmd
-          in
-          let running =
-            M.add n (p, cont, OpamProcess.text_of_command cmd) running
+      let block p n blocked =
+        OpamStd.IntMap.update p (S.add n) S.empty blocked
+      in
+      (* Moves the nodes waiting on pool [p] back to [ready], until one is
+         found that isn't blocked by another pool *)
+      let rec unblock nslots p (ready, blocked) =
+        match OpamStd.IntMap.find_opt p blocked with
+        | None -> ready, blocked
+        | Some waiting ->
+          let m = S.choose waiting in
+          let waiting = S.remove m waiting in
+          let blocked =
+            if S.is_empty waiting then OpamStd.IntMap.remove p blocked
+            else OpamStd.IntMap.add p waiting blocked
           in
-          print_status (M.cardinal results) running;
-          loop nslots results running ready
+          match full_pool nslots m with
+          | None -> S.add m ready, blocked
+          | Some q -> unblock nslots p (ready, block q m blocked)
       in
 
       let fail node error =
@@ -204,10 +202,17 @@ module Make (G : G) = struct
           (slog (string_of_int @* V.hash)) node
           (slog V.to_string) node;
         if error = Sys.Break then OpamConsole.error "User interruption";
+        if OpamTrace.enabled () then
+          OpamTrace.async_end ~cat:"job" ~id:(V.hash node) (V.to_string node);
         let running = M.remove node running in
+        (* Computations can't be interrupted: just forget about them *)
+        let errors =
+          M.fold (fun n _ errors -> (n,Aborted) :: errors)
+            (M.remove node computing) [node,error]
+        in
         (* Cleanup *)
         let errors,pend =
-          if dry_run then [node,error],[] else
+          if dry_run then errors,[] else
           M.fold (fun n (p,cont,_text) (errors,pend) ->
               try
                 match OpamProcess.dontwait p with
@@ -218,13 +223,13 @@ module Make (G : G) = struct
                 | Some result ->
                   match cont result with
                   | Done _ -> errors, pend
-                  | Run _ ->
+                  | Run _ | Compute _ ->
                     (n,Aborted) :: errors,
                     pend
               with
               | Unix.Unix_error _ -> errors, pend
               | e -> (n,e)::errors, pend)
-            running ([node,error],[])
+            running (errors,[])
         in
         (try List.iter (fun _ -> ignore (OpamProcess.wait_one pend)) pend
          with e -> log "%a in sub-process cleanup" (slog Printexc.to_string) e);
@@ -239,75 +244,161 @@ module Make (G : G) = struct
         raise (Errors (M.keys results, List.rev errors, List.rev remaining))
       in
 
-      if M.is_empty running && S.is_empty ready then
+      let rec run_seq_command nslots ready blocked computing n = function
+        | Done r ->
+          log "Job %a finished" (slog (string_of_int @* V.hash)) n;
+          if OpamTrace.enabled () then
+            OpamTrace.async_end ~cat:"job" ~id:(V.hash n) (V.to_string n);
+          let results = M.add n r results in
+          let running = M.remove n running in
+          if not (M.is_empty running) then
+            print_status (M.cardinal results) running;
+          let nslots = release_slot nslots n in
+          let ready, blocked =
+            List.fold_left (fun acc p -> unblock nslots p acc)
+              (ready, blocked) (pools_of n)
+          in
+          let ready =
+            List.fold_left (fun ready n ->
+                if List.for_all (fun n -> M.mem n results) (G.pred g n)
+                then S.add n ready else ready)
+              ready (G.succ g n)
+          in
+          loop nslots results running computing ready blocked
+        | Run (cmd, cont) ->
+          log "Next task in job %a: %a" (slog (string_of_int @* V.hash)) n
+            (slog OpamProcess.string_of_command) cmd;
+          let p =
+            if dry_run then OpamProcess.dry_run_background cmd
+            else OpamProcess.run_background cmd
+          in
+          let running =
+            M.add n (p, cont, OpamProcess.text_of_command cmd) running
+          in
+          print_status (M.cardinal results) running;
+          if OpamTrace.enabled () then
+            OpamTrace.counter "running processes" (M.cardinal running);
+          loop nslots results running computing ready blocked
+        | Compute f when M.cardinal computing < OpamCompute.max_parallel ->
+          log "Next task in job %a: computation"
+            (slog (string_of_int @* V.hash)) n;
+          let running = M.remove n running in
+          let computing = M.add n (OpamCompute.spawn f) computing in
+          loop nslots results running computing ready blocked
+        | Compute f ->
+          (* No domain available: compute right away *)
+          let next = try f () () with e -> fail n e in
+          run_seq_command nslots ready blocked computing n next
+      in
+
+      if M.is_empty running && M.is_empty computing && S.is_empty ready then
         results
-      else if
-        not (S.is_empty ready) &&
-        List.exists (fun (_, slots) -> slots > 0) nslots
-      then
-        (* Start a new process *)
+      else if not (S.is_empty ready) then
         let n = S.choose ready in
-        log "Starting job %a (worker %a): %a"
-          (slog (string_of_int @* V.hash)) n
-          (slog
-             (fun pools ->
-                let slots = get_slots nslots n in
-                OpamStd.List.concat_map " " (fun (pool, jobs) ->
-                    let nslots =
-                      OpamStd.List.assoc_opt S.equal pool slots
-                    in
-                  Printf.sprintf "%s/%d"
-                    (match nslots with
-                     | None -> "-"
-                     | Some n -> string_of_int (jobs - n + 1))
-                    jobs)
-                  pools))
-          pools
-          (slog V.to_string) n;
-        let pred = G.pred g n in
-        let pred = List.map (fun n -> n, M.find n results) pred in
-        let cmd = try command ~pred n with e -> fail n e in
-        let nslots = take_slot nslots n in
-        let ready =
-          List.fold_left
-            (fun acc (pool, slots) ->
-               if slots = 0 then acc -- pool else acc)
-            (S.remove n ready)
-            (get_slots nslots n)
-        in
-        run_seq_command nslots ready n cmd
+        (match full_pool nslots n with
+         | Some p ->
+           loop nslots results running computing
+             (S.remove n ready) (block p n blocked)
+         | None ->
+           (* Start a new process *)
+           log "Starting job %a (worker %a): %a"
+             (slog (string_of_int @* V.hash)) n
+             (slog
+                (OpamStd.List.concat_map " " (fun p ->
+                     let jobs = OpamStd.IntMap.find p pool_sizes in
+                     Printf.sprintf "%d/%d"
+                       (jobs - OpamStd.IntMap.find p nslots + 1) jobs)))
+             (pools_of n)
+             (slog V.to_string) n;
+           if OpamTrace.enabled () then
+             OpamTrace.async_begin ~cat:"job" ~id:(V.hash n) (V.to_string n);
+           let pred = G.pred g n in
+           let pred = List.map (fun n -> n, M.find n results) pred in
+           let cmd = try command ~pred n with e -> fail n e in
+           let nslots = take_slot nslots n in
+           run_seq_command nslots (S.remove n ready) blocked computing n cmd)
       else (
-        (* Wait for a process to end *)
+        (* Wait for a process or a computation to end *)
         if not !gc_compacted then
           (gc_compact ();
            gc_compacted := true);
-        let processes =
-          M.fold (fun n (p,x,_) acc -> (p,(n,x)) :: acc) running []
+        let collect n cont result =
+          log "Collected task for job %a (ret:%d)"
+            (slog (string_of_int @* V.hash)) n result.OpamProcess.r_code;
+          let next =
+            try cont result with e ->
+              OpamProcess.cleanup result;
+              fail n e in
+          OpamProcess.cleanup result;
+          run_seq_command nslots ready blocked computing n next
         in
-        let process, result =
-          if dry_run then
-            OpamProcess.dry_wait_one (List.map fst processes)
-          else try match processes with
-            | [p,_] -> p, OpamProcess.wait p
-            | _ -> OpamProcess.wait_one (List.map fst processes)
-            with e -> fail (fst (snd (List.hd processes))) e
+        let computed =
+          M.fold (fun n c acc ->
+              match acc with
+              | Some _ -> acc
+              | None ->
+                try OpamCompute.poll c |> Option.map (fun k -> n, k)
+                with e -> fail n e)
+            computing None
         in
-        let n,cont = OpamStd.(List.assoc Compare.equal process processes) in
-        log "Collected task for job %a (ret:%d)"
-          (slog (string_of_int @* V.hash)) n result.OpamProcess.r_code;
-        let next =
-          try cont result with e ->
-            OpamProcess.cleanup result;
-            fail n e in
-        OpamProcess.cleanup result;
-        run_seq_command nslots ready n next)
+        match computed with
+        | Some (n, k) ->
+          log "Collected computation for job %a"
+            (slog (string_of_int @* V.hash)) n;
+          let computing = M.remove n computing in
+          let next = try k () with e -> fail n e in
+          run_seq_command nslots ready blocked computing n next
+        | None when M.is_empty running ->
+          ignore (OpamCompute.await (fun () -> None));
+          loop nslots results running computing ready blocked
+        | None when not dry_run && not (M.is_empty computing) ->
+          (* Don't block on processes while computations are pending: wait
+             for either a computation or a process (SIGCHLD) to end *)
+          let finished () =
+            M.fold (fun n (p,cont,_) acc ->
+                match acc with
+                | Some _ -> acc
+                | None ->
+                  try
+                    OpamProcess.dontwait p
+                    |> Option.map (fun r -> n, cont, r)
+                  with e -> fail n e)
+              running None
+          in
+          (* The outputs captured from the processes are read meanwhile *)
+          let wake_on_fds =
+            M.fold (fun _ (p,_,_) fds -> OpamProcess.output_fds p @ fds)
+              running []
+          in
+          (match
+             OpamCompute.await ~wake_on_signal:Sys.sigchld ~wake_on_fds
+               finished
+           with
+           | Some (n, cont, result) -> collect n cont result
+           | None -> loop nslots results running computing ready blocked)
+        | None ->
+          let processes =
+            M.fold (fun n (p,x,_) acc -> (p,(n,x)) :: acc) running []
+          in
+          let process, result =
+            if dry_run then
+              OpamProcess.dry_wait_one (List.map fst processes)
+            else try match processes with
+              | [p,_] -> p, OpamProcess.wait p
+              | _ -> OpamProcess.wait_one (List.map fst processes)
+              with e -> fail (fst (snd (List.hd processes))) e
+          in
+          let n,cont = OpamStd.(List.assoc Compare.equal process processes) in
+          collect n cont result)
     in
     let roots =
       G.fold_vertex
         (fun n roots -> if G.in_degree g n = 0 then S.add n roots else roots)
         g S.empty
     in
-    let r = loop pools M.empty M.empty roots in
+    let r =
+      loop pool_sizes M.empty M.empty M.empty roots OpamStd.IntMap.empty
+    in
     OpamConsole.clear_status ();
     r
 
@@ -485,26 +576,26 @@ let flat_graph_of_array a =
 
 exception Errors = IntGraph.Parallel.Errors
 
-let iter ~jobs ~command ?dry_run l =
+let iter ~jobs ~command ?dry_run ?pools l =
   let a = Array.of_list l in
   let g = flat_graph_of_array a in
   let command ~pred:_ i = command a.(i) in
-  ignore (IntGraph.Parallel.iter ~jobs ~command ?dry_run g)
+  ignore (IntGraph.Parallel.iter ~jobs ~command ?dry_run ?pools g)
 
-let map ~jobs ~command ?dry_run l =
+let map ~jobs ~command ?dry_run ?pools l =
   let a = Array.of_list l in
   let g = flat_graph_of_array a in
   let command ~pred:_ i = command a.(i) in
-  let r = IntGraph.Parallel.aux_map ~jobs ~command ?dry_run g in
+  let r = IntGraph.Parallel.aux_map ~jobs ~command ?dry_run ?pools g in
   let rec mklist acc n =
     if n < 0 then acc
     else mklist (IntGraph.Parallel.M.find n r :: acc) (n-1)
   in
   mklist [] (Array.length a - 1)
 
-let reduce ~jobs ~command ~merge ~nil ?dry_run l =
+let reduce ~jobs ~command ~merge ~nil ?dry_run ?pools l =
   let a = Array.of_list l in
   let g = flat_graph_of_array a in
   let command ~pred:_ i = command a.(i) in
-  let r = IntGraph.Parallel.aux_map ~jobs ~command ?dry_run g in
+  let r = IntGraph.Parallel.aux_map ~jobs ~command ?dry_run ?pools g in
   IntGraph.Parallel.M.fold (fun _ -> merge) r nil
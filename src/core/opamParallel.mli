@@ -39,15 +39,19 @@ exception Aborted
     which raised exceptions, and third one those which were canceled. *)
 exception Errors of int list * (int * exn) list * int list
 
+(** In the simple cases, [pools] are given as lists of indexes of the jobs in
+    the list, with the number of processes allowed for each; see
+    {!SIG.iter}. *)
+
 val iter: jobs:int -> command:('a -> unit OpamProcess.job) -> ?dry_run:bool ->
-  'a list -> unit
+  ?pools:((int list * int) list) -> 'a list -> unit
 
 val map: jobs:int -> command:('a -> 'b OpamProcess.job) -> ?dry_run:bool ->
-  'a list -> 'b list
+  ?pools:((int list * int) list) -> 'a list -> 'b list
 
 val reduce: jobs:int -> command:('a -> 'b OpamProcess.job) ->
   merge:('b -> 'b -> 'b) -> nil:'b -> ?dry_run:bool ->
-  'a list -> 'b
+  ?pools:((int list * int) list) -> 'a list -> 'b
 
 (** More complex parallelism with dependency graphs *)
 
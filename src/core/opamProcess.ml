@@ -239,6 +239,22 @@ let command ?env ?verbose ?name ?metadata ?dir ?allow_stdin ?stdout ?text
 
 (** Running processes *)
 
+(* Output of a process read through a pipe. It is kept in memory up to
+   [capture_limit] bytes, and past that appended to its log file, so that the
+   whole output is still available once the process has ended *)
+type capture = {
+  cap_fd: Unix.file_descr;
+  cap_file: string;
+  cap_buf: Buffer.t;
+  mutable cap_spill: out_channel option; (* the log file, once written to *)
+  mutable cap_eof: bool;
+}
+
+type captured = {
+  cap_stdout: capture;
+  cap_stderr: capture option; (* [None] if merged with stdout *)
+}
+
 type t = {
   p_name   : string;
   p_args   : string list;
@@ -252,6 +268,8 @@ type t = {
   p_metadata: (string * string) list;
   p_verbose: bool;
   p_tmp_files: string list;
+  p_deferred_env: string array option;
+  p_capture: captured option;
 }
 
 let output_lines oc lines =
@@ -294,6 +312,17 @@ let make_info ?code ?signal
 
   List.rev !b
 
+let write_env_file f env =
+  let chan = open_out f in
+  let env = Array.to_list env in
+  (* Remove dubious variables *)
+  let env =
+    List.filter (fun line -> not (String.contains line '$'))
+      env
+  in
+  output_lines chan env;
+  close_out chan
+
 let string_of_info ?(color=`yellow) info =
   let b = Buffer.create 1024 in
   List.iter
@@ -302,6 +331,11 @@ let string_of_info ?(color=`yellow) info =
         (OpamConsole.colorise color k) v) info;
   Buffer.contents b
 
+let write_info_file f info =
+  let chan = open_out f in
+  output_string chan (string_of_info info);
+  close_out chan
+
 let resolve_command ?env ?dir name =
   let env = match env with None -> default_env () | Some e -> e in
   match OpamStd.Sys.resolve_command ~env ?dir name with
@@ -327,15 +361,26 @@ let create_process_env =
     outputs are discarded is [verbose] is set to false. The current
     environment can also be overridden if [env] is set. The environment
     which is used to run the process is recorded into [env_file] (if
-    set). *)
+    set). If [defer_logs] is set, the env and info files are only written
+    once the process has ended, and if it failed. If [capture] is set, the
+    outputs are read through pipes, and only written to [stdout_file] and
+    [stderr_file] if they are large or the process fails. *)
 let create ?info_file ?env_file ?(allow_stdin=not Sys.win32) ?stdout_file ?stderr_file ?env ?(metadata=[]) ?dir
-    ~verbose ~tmp_files cmd args =
+    ?(defer_logs=false) ?(capture=false) ~verbose ~tmp_files cmd args =
   let nothing () = () in
   let tee f =
     let flags = [Unix.O_WRONLY; Unix.O_CREAT; Unix.O_APPEND; Unix.O_SHARE_DELETE] in
     let fd = Unix.openfile f flags 0o644 in
     let close_fd () = Unix.close fd in
     fd, close_fd in
+  let capture_pipe f =
+    (* The write end is only inherited by the child through dup2 *)
+    let fd, outfd = Unix.pipe ~cloexec:true () in
+    Unix.set_nonblock fd;
+    { cap_fd = fd; cap_file = f; cap_buf = Buffer.create 4096;
+      cap_spill = None; cap_eof = false },
+    (outfd, fun () -> Unix.close outfd)
+  in
   let oldcwd = Sys.getcwd () in
   let cwd = OpamStd.Option.default oldcwd dir in
   let with_chdir dir =
@@ -352,45 +397,47 @@ let create ?info_file ?env_file ?(allow_stdin=not Sys.win32) ?stdout_file ?stder
     let close_stdin () = Unix.close fd in
     Unix.close outfd; fd, close_stdin
   in
-  let stdout_fd, close_stdout = match stdout_file with
-    | None   -> Unix.stdout, nothing
-    | Some f -> tee f in
-  let stderr_fd, close_stderr = match stderr_file with
-    | None   -> Unix.stderr, nothing
-    | Some f ->
-      if stdout_file = Some f then stdout_fd, nothing
-      else tee f
+  let captured, (stdout_fd, close_stdout), (stderr_fd, close_stderr) =
+    match stdout_file, stderr_file with
+    | Some out_f, Some err_f when capture ->
+      let out, out_fds = capture_pipe out_f in
+      let err, err_fds =
+        if err_f = out_f then None, (fst out_fds, nothing)
+        else let err, err_fds = capture_pipe err_f in Some err, err_fds
+      in
+      Some { cap_stdout = out; cap_stderr = err }, out_fds, err_fds
+    | _ ->
+      let stdout = match stdout_file with
+        | None   -> Unix.stdout, nothing
+        | Some f -> tee f in
+      let stderr = match stderr_file with
+        | None   -> Unix.stderr, nothing
+        | Some f ->
+          if stdout_file = Some f then fst stdout, nothing
+          else tee f
+      in
+      None, stdout, stderr
+  in
+  let close_captured () =
+    Option.iter (fun c ->
+        Unix.close c.cap_stdout.cap_fd;
+        Option.iter (fun e -> Unix.close e.cap_fd) c.cap_stderr)
+      captured
   in
   let env = match env with
     | None   -> default_env ()
     | Some e -> e in
   let time = Unix.gettimeofday () in
 
-  let () =
+  if not defer_logs then (
     (* write the env file before running the command*)
-    match env_file with
-    | None   -> ()
-    | Some f ->
-      let chan = open_out f in
-      let env = Array.to_list env in
-      (* Remove dubious variables *)
-      let env =
-        List.filter (fun line -> not (String.contains line '$'))
-          env
-      in
-      output_lines chan env;
-      close_out chan in
-
-  let () =
-    (* write the info file *)
-    match info_file with
-    | None   -> ()
-    | Some f ->
-      let chan = open_out f in
-      let info =
-        make_info ~cmd ~args ~cwd ~env_file ~stdout_file ~stderr_file ~metadata () in
-      output_string chan (string_of_info info);
-      close_out chan in
+    Option.iter (fun f -> write_env_file f env) env_file;
+    Option.iter (fun f ->
+        write_info_file f
+          (make_info ~cmd ~args ~cwd ~env_file ~stdout_file ~stderr_file
+             ~metadata ()))
+      info_file
+  );
 
   let pid =
     let cmd, args =
@@ -455,6 +502,7 @@ let create ?info_file ?env_file ?(allow_stdin=not Sys.win32) ?stdout_file ?stder
       close_stdin  ();
       close_stdout ();
       close_stderr ();
+      close_captured ();
       raise e in
   close_stdin  ();
   close_stdout ();
@@ -472,6 +520,8 @@ let create ?info_file ?env_file ?(allow_stdin=not Sys.win32) ?stdout_file ?stder
     p_metadata = metadata;
     p_verbose = verbose;
     p_tmp_files = tmp_files;
+    p_deferred_env = if defer_logs then Some env else None;
+    p_capture = captured;
   }
 
 type result = {
@@ -561,8 +611,19 @@ let run_background command =
       else stdout_file;
     ]
   in
+  (* The env and info files are only useful to investigate failures: avoid
+     writing them for every command, unless debugging or keeping logs *)
+  let defer_logs =
+    not (OpamConsole.debug ()) && not OpamCoreConfig.(!r.keep_log_dir)
+  in
+  (* Likewise, avoid the round-trip through the output files when the outputs
+     aren't displayed or redirected. Not on Windows, where pipes can't be
+     waited on along with processes. *)
+  let capture =
+    defer_logs && not Sys.win32 && cmd_stdout = None && not verbose
+  in
   create ~env ?info_file ?env_file ?stdout_file ?stderr_file ~verbose ?metadata
-    ~allow_stdin ?dir ~tmp_files cmd args
+    ~allow_stdin ?dir ~defer_logs ~capture ~tmp_files cmd args
 
 let dry_run_background c = {
   p_name   = c.cmd;
@@ -577,6 +638,8 @@ let dry_run_background c = {
   p_metadata = OpamStd.Option.default [] c.cmd_metadata;
   p_verbose = is_verbose_command c;
   p_tmp_files = [];
+  p_deferred_env = None;
+  p_capture = None;
 }
 
 let verbose_print_cmd p =
@@ -641,15 +704,105 @@ let set_verbose_process p =
       set_verbose_f fs
     )
 
+(** Outputs captured through pipes *)
+
+let capture_limit = 1 lsl 20
+
+let read_chunk = Bytes.create 65536
+
+let captures p = match p.p_capture with
+  | None -> []
+  | Some { cap_stdout; cap_stderr = None } -> [cap_stdout]
+  | Some { cap_stdout; cap_stderr = Some err } -> [cap_stdout; err]
+
+let output_fds p =
+  List.filter_map (fun c -> if c.cap_eof then None else Some c.cap_fd)
+    (captures p)
+
+let spill c =
+  match c.cap_spill with
+  | Some oc -> oc
+  | None ->
+    let oc =
+      open_out_gen [Open_wronly; Open_creat; Open_append; Open_binary] 0o644
+        c.cap_file
+    in
+    Buffer.output_buffer oc c.cap_buf;
+    Buffer.reset c.cap_buf;
+    c.cap_spill <- Some oc;
+    oc
+
+let close_capture c =
+  if not c.cap_eof then (
+    c.cap_eof <- true;
+    Unix.close c.cap_fd;
+    Option.iter close_out c.cap_spill)
+
+(* Reads the output available on [c], at most [n] chunks of it. Returns
+   [false] if there was none *)
+let rec read_capture n c =
+  n > 0 && not c.cap_eof &&
+  match Unix.read c.cap_fd read_chunk 0 (Bytes.length read_chunk) with
+  | 0 -> close_capture c; true
+  | len ->
+    if Option.is_none c.cap_spill && Buffer.length c.cap_buf + len <= capture_limit
+    then Buffer.add_subbytes c.cap_buf read_chunk 0 len
+    else output (spill c) read_chunk 0 len;
+    ignore (read_capture (n - 1) c);
+    true
+  | exception Unix.Unix_error ((Unix.EAGAIN | Unix.EWOULDBLOCK | Unix.EINTR),
+                              _, _) -> false
+
+let read_outputs p =
+  List.iter (fun c -> ignore (read_capture 16 c)) (captures p)
+
+(* To be called once the process has ended. Pipes still open after that are
+   held by its own sub-processes, which are not waited for *)
+let finish_capture p =
+  List.iter (fun c ->
+      let rec aux n = if read_capture 16 c && n > 0 then aux (n - 1) in
+      aux 64;
+      close_capture c)
+    (captures p)
+
+let captured_lines c =
+  match c.cap_spill with
+  | Some _ -> read_lines c.cap_file
+  | None ->
+    let lines = String.split_on_char '\n' (Buffer.contents c.cap_buf) in
+    match List.rev lines with
+    | "" :: rlines -> List.rev rlines
+    | _ -> lines
+
+(* Writes the env and info files of a process that has ended, and the outputs
+   it captured *)
+let write_deferred_logs p env info =
+  try
+    List.iter (fun c ->
+        if Option.is_none c.cap_spill then close_out (spill c))
+      (captures p);
+    Option.iter (fun f -> write_env_file f env) p.p_env;
+    Option.iter (fun f -> write_info_file f info) p.p_info
+  with Sys_error e -> log "Could not write the logs of %s: %s" p.p_name e
+
 let exit_status p return =
   let duration = Unix.gettimeofday () -. p.p_time in
-  let stdout = OpamStd.Option.default [] (Option.map read_lines p.p_stdout) in
-  let stderr = OpamStd.Option.default [] (Option.map read_lines p.p_stderr) in
-  let cleanup = p.p_tmp_files in
+  let stdout, stderr = match p.p_capture with
+    | None ->
+      OpamStd.Option.default [] (Option.map read_lines p.p_stdout),
+      OpamStd.Option.default [] (Option.map read_lines p.p_stderr)
+    | Some { cap_stdout; cap_stderr } ->
+      let stdout = captured_lines cap_stdout in
+      stdout,
+      OpamStd.Option.map_default captured_lines stdout cap_stderr
+  in
   let code,signal = match return with
     | Unix.WEXITED r -> Some r, None
     | Unix.WSIGNALED s | Unix.WSTOPPED s -> None, Some s
   in
+  if OpamTrace.enabled () then
+    OpamTrace.complete ~cat:"process" ~tid:p.p_pid ~start:p.p_time
+      (String.concat " " (p.p_name :: p.p_args));
   if isset_verbose_f () then
     stop_verbose_f ()
   else if p.p_verbose then
@@ -661,6 +814,9 @@ let exit_status p return =
     make_info ?code ?signal
       ~cmd:p.p_name ~args:p.p_args ~cwd:p.p_cwd ~metadata:p.p_metadata
       ~env_file:p.p_env ~stdout_file:p.p_stdout ~stderr_file:p.p_stderr () in
+  (match p.p_deferred_env with
+   | Some env when code <> Some 0 -> write_deferred_logs p env info
+   | _ -> ());
   {
     r_code     = OpamStd.Option.default 256 code;
     r_signal   = signal;
@@ -668,7 +824,7 @@ let exit_status p return =
     r_info     = info;
     r_stdout   = stdout;
     r_stderr   = stderr;
-    r_cleanup  = cleanup;
+    r_cleanup  = p.p_tmp_files;
   }
 
 let safe_wait fallback_pid f x =
@@ -702,20 +858,86 @@ let safe_wait fallback_pid f x =
   try let r = aux () in cleanup (); r
   with e -> cleanup (); raise e
 
+let dead_childs = Hashtbl.create 13
+
+(* Written to by the SIGCHLD handler, so that waiting on the pipes of the
+   processes can be interrupted when one ends *)
+let sigchld_pipe =
+  lazy
+    (let r, w = Unix.pipe ~cloexec:true () in
+     Unix.set_nonblock r;
+     Unix.set_nonblock w;
+     r, w)
+
+(* Waits for one of [processes] to end, reading their captured outputs
+   meanwhile, lest they block on full pipes *)
+let wait_capturing processes =
+  let r, w = Lazy.force sigchld_pipe in
+  let prev =
+    Sys.signal Sys.sigchld
+      (Sys.Signal_handle (fun _ ->
+           try ignore (Unix.single_write w (Bytes.make 1 '\000') 0 1)
+           with Unix.Unix_error _ -> ()))
+  in
+  OpamStd.Exn.finally (fun () -> Sys.set_signal Sys.sigchld prev) @@ fun () ->
+  let ended p =
+    match Hashtbl.find_opt dead_childs p.p_pid with
+    | Some return -> Hashtbl.remove dead_childs p.p_pid; Some (p, return)
+    | None ->
+      match safe_wait p.p_pid (Unix.waitpid [Unix.WNOHANG]) p.p_pid with
+      | 0, _ -> None
+      | _, return -> Some (p, return)
+  in
+  let rec aux () =
+    (* The handler is installed: a process ending after this check wakes the
+       select below up *)
+    match OpamStd.List.find_map_opt ended processes with
+    | Some r -> r
+    | None ->
+      let fds = List.flatten (List.map output_fds processes) in
+      (match Unix.select (r :: fds) [] [] (-1.) with
+       | ready, _, _ ->
+         List.iter (fun p ->
+             List.iter (fun c ->
+                 if List.mem c.cap_fd ready then ignore (read_capture 16 c))
+               (captures p))
+           processes;
+         if List.mem r ready then
+           let buf = Bytes.create 64 in
+           let rec drain () =
+             match Unix.read r buf 0 (Bytes.length buf) with
+             | 0 -> ()
+             | _ -> drain ()
+             | exception Unix.Unix_error _ -> ()
+           in
+           drain ()
+       | exception Unix.Unix_error (Unix.EINTR, _, _) -> ());
+      aux ()
+  in
+  aux ()
+
 let wait p =
   set_verbose_process p;
-  let _, return = safe_wait p.p_pid (Unix.waitpid []) p.p_pid in
+  let return =
+    if Option.is_none p.p_capture then
+      snd (safe_wait p.p_pid (Unix.waitpid []) p.p_pid)
+    else snd (wait_capturing [p])
+  in
+  finish_capture p;
   exit_status p return
 
 let dontwait p =
+  read_outputs p;
   match safe_wait p.p_pid (Unix.waitpid [Unix.WNOHANG]) p.p_pid with
   | 0, _ -> None
-  | _, return -> Some (exit_status p return)
+  | _, return -> finish_capture p; Some (exit_status p return)
 
-let dead_childs = Hashtbl.create 13
 let wait_one processes =
   if processes = [] then raise (Invalid_argument "wait_one");
   let p, return =
+    if List.exists (fun p -> Option.is_some p.p_capture) processes then
+      wait_capturing processes
+    else
     try
       let p =
         List.find (fun p -> Hashtbl.mem dead_childs p.p_pid) processes
@@ -746,6 +968,7 @@ let wait_one processes =
       aux ()
   in
   if p.p_verbose then verbose_print_cmd p;
+  finish_capture p;
   p, exit_status p return
 
 let dry_wait_one = function
@@ -873,6 +1096,7 @@ module Job = struct
     type 'a job = (* Open the variant type *)
       | Done of 'a
       | Run of command * (result -> 'a job)
+      | Compute of (unit -> unit -> 'a job)
 
     (* Parallelise shell commands *)
     let (@@>) command f = Run (command, f)
@@ -881,12 +1105,16 @@ module Job = struct
     let rec (@@+) job1 fjob2 = match job1 with
       | Done x -> fjob2 x
       | Run (cmd,cont) -> Run (cmd, fun r -> cont r @@+ fjob2)
+      | Compute f ->
+        Compute (fun () -> let k = f () in fun () -> k () @@+ fjob2)
 
     let (@@|) job f = job @@+ fun x -> Done (f x)
   end
 
   open Op
 
+  let compute f = Compute (fun () -> let x = f () in fun () -> Done x)
+
   let run =
     let rec aux = function
       | Done x -> x
@@ -909,6 +1137,7 @@ module Job = struct
         cleanup r;
         OpamConsole.clear_status ();
         aux k
+      | Compute f -> aux (f () ())
     in
     aux
 
@@ -916,12 +1145,18 @@ module Job = struct
     | Done x -> x
     | Run (_command,cont) ->
       dry_run (cont empty_result)
+    | Compute f -> dry_run (f () ())
 
   let rec catch handler fjob =
     try match fjob () with
       | Done x -> Done x
       | Run (cmd,cont) ->
         Run (cmd, fun r -> catch handler (fun () -> cont r))
+      | Compute f ->
+        (* The computation may raise outside of this function *)
+        Compute (fun () -> match f () with
+            | k -> fun () -> catch handler k
+            | exception e -> fun () -> handler e)
     with e -> handler e
 
   let ignore_errors ~default ?message job =
@@ -936,6 +1171,10 @@ module Job = struct
       | Done x -> fin (); Done x
       | Run (cmd,cont) ->
         Run (cmd, fun r -> finally fin (fun () -> cont r))
+      | Compute f ->
+        Compute (fun () -> match f () with
+            | k -> fun () -> finally fin k
+            | exception e -> fun () -> fin (); raise e)
     with e -> fin (); raise e
 
   let of_list ?(keep_going=false) l =
@@ -979,6 +1218,8 @@ module Job = struct
     | Done _ as j -> j
     | Run (cmd, cont) ->
       Run ({cmd with cmd_text = Some text}, fun r -> with_text text (cont r))
+    | Compute f ->
+      Compute (fun () -> let k = f () in fun () -> with_text text (k ()))
 end
 
 type 'a job = 'a Job.Op.job
@@ -60,6 +60,9 @@ val make_command_text:
   ?color:OpamConsole.text_style -> string -> ?args:string list -> string ->
   string
 
+(** Outputs of a process read through pipes *)
+type captured
+
 (** The type for processes *)
 type t = {
   p_name   : string;        (** Command name *)
@@ -76,6 +79,12 @@ type t = {
                                 displayed *)
   p_tmp_files: string list; (** temporary files that should be cleaned up upon
                                 completion *)
+  p_deferred_env: string array option; (** environment of the process, when
+                                           its env and info files are only
+                                           written if it fails *)
+  p_capture: captured option; (** outputs read through pipes. They are kept
+                                  in memory, and only written to the dump
+                                  files if large or if the process fails *)
 }
 
 (** Process results *)
@@ -114,6 +123,11 @@ val wait: t -> result
 (** Like {!wait}, but returns None immediately if the process hasn't ended *)
 val dontwait: t -> result option
 
+(** The pipes the outputs of the process are read from, while they are open.
+    They must be read, by calling {!dontwait}, whenever they have data
+    available, lest the process blocks writing to them. *)
+val output_fds: t -> Unix.file_descr list
+
 (** Wait for the first of the listed processes to terminate, and return its
     termination status *)
 val wait_one: t list -> t * result
@@ -161,6 +175,10 @@ module Job: sig
     type 'a job =
       | Done of 'a
       | Run of command * (result -> 'a job)
+      | Compute of (unit -> unit -> 'a job)
+      (** [Compute f]: [f ()] is a pure OCaml computation, that may be run
+          on a separate domain (see {!OpamCompute}); the function it returns
+          is then called from the main program to get the rest of the job *)
 
     (** Stage a shell command with its continuation, eg:
         {[
@@ -180,6 +198,11 @@ module Job: sig
     val (@@|): 'a job -> ('a -> 'b) -> 'b job
   end
 
+  (** [compute f] is the job that returns [f ()], where [f] is a pure OCaml
+      computation that may be run alongside other jobs. See {!OpamCompute} for
+      the restrictions on [f]. *)
+  val compute: (unit -> 'a) -> 'a Op.job
+
   (** Sequential run of a job *)
   val run: 'a Op.job -> 'a
 
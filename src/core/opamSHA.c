@@ -0,0 +1,534 @@
+/**************************************************************************/
+/*                                                                        */
+/*    Copyright 2026 OCamlPro                                             */
+/*                                                                        */
+/*  All rights reserved. This file is distributed under the terms of the  */
+/*  GNU Lesser General Public License version 2.1, with the special       */
+/*  exception on linking described in the file LICENSE.                   */
+/*                                                                        */
+/**************************************************************************/
+
+/* Hashing kernels. SHA-256 uses the SHA extensions of x86 (SHA-NI, detected
+   at runtime) and of ARMv8 (when the compiler targets them), with a portable
+   fallback. Files are hashed with the runtime lock released, for all the
+   requested kinds in one pass. They are read rather than mapped: a mapped file
+   that is truncated while being hashed raises SIGBUS. */
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <caml/md5.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define OPAM_SHA_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_SHA2)
+#define OPAM_SHA_ARM
+#include <arm_neon.h>
+#endif
+
+#include <fcntl.h>
+
+static const uint32_t sha256_k[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+  0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+  0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+  0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+  0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+  0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+  0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+  0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+  0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_blocks_generic(uint32_t st[8], const uint8_t *p,
+                                  size_t blocks)
+{
+  uint32_t w[64], a, b, c, d, e, f, g, h, t1, t2;
+  int i;
+
+  for (; blocks > 0; blocks--, p += 64) {
+    for (i = 0; i < 16; i++)
+      w[i] = (uint32_t) p[4*i] << 24 | (uint32_t) p[4*i+1] << 16
+        | (uint32_t) p[4*i+2] << 8 | (uint32_t) p[4*i+3];
+    for (i = 16; i < 64; i++) {
+      t1 = ROTR(w[i-2], 17) ^ ROTR(w[i-2], 19) ^ (w[i-2] >> 10);
+      t2 = ROTR(w[i-15], 7) ^ ROTR(w[i-15], 18) ^ (w[i-15] >> 3);
+      w[i] = w[i-16] + t2 + w[i-7] + t1;
+    }
+    a = st[0]; b = st[1]; c = st[2]; d = st[3];
+    e = st[4]; f = st[5]; g = st[6]; h = st[7];
+    for (i = 0; i < 64; i++) {
+      t1 = h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25))
+        + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+      t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22))
+        + ((a & b) ^ (a & c) ^ (b & c));
+      h = g; g = f; f = e; e = d + t1;
+      d = c; c = b; b = a; a = t1 + t2;
+    }
+    st[0] += a; st[1] += b; st[2] += c; st[3] += d;
+    st[4] += e; st[5] += f; st[6] += g; st[7] += h;
+  }
+}
+
+/* Set by the tests, to check the portable kernel on any machine */
+static int sha256_portable = 0;
+
+#ifdef OPAM_SHA_X86
+
+__attribute__((target("sha,sse4.1")))
+static void sha256_blocks_shani(uint32_t st[8], const uint8_t *p,
+                                size_t blocks)
+{
+  const __m128i bswap =
+    _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+  __m128i state0, state1, abef, cdgh, msg, tmp, w[4];
+  int i;
+
+  /* The instructions work on the ABEF and CDGH halves of the state */
+  tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *) &st[0]), 0xB1);
+  state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *) &st[4]), 0x1B);
+  state0 = _mm_alignr_epi8(tmp, state1, 8);
+  state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+  for (; blocks > 0; blocks--, p += 64) {
+    abef = state0;
+    cdgh = state1;
+    for (i = 0; i < 4; i++)
+      w[i] = _mm_shuffle_epi8
+        (_mm_loadu_si128((const __m128i *) (p + 16 * i)), bswap);
+    /* Four rounds per iteration; w[i % 4] holds the schedule words of the
+       current rounds, and the following ones are computed on the fly */
+    for (i = 0; i < 16; i++) {
+      msg = _mm_add_epi32
+        (w[i & 3], _mm_loadu_si128((const __m128i *) &sha256_k[4 * i]));
+      state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+      if (i >= 3 && i < 15) {
+        tmp = _mm_alignr_epi8(w[i & 3], w[(i - 1) & 3], 4);
+        w[(i + 1) & 3] = _mm_add_epi32(w[(i + 1) & 3], tmp);
+        w[(i + 1) & 3] = _mm_sha256msg2_epu32(w[(i + 1) & 3], w[i & 3]);
+      }
+      msg = _mm_shuffle_epi32(msg, 0x0E);
+      state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+      if (i >= 1 && i < 13)
+        w[(i - 1) & 3] = _mm_sha256msg1_epu32(w[(i - 1) & 3], w[i & 3]);
+    }
+    state0 = _mm_add_epi32(state0, abef);
+    state1 = _mm_add_epi32(state1, cdgh);
+  }
+
+  tmp = _mm_shuffle_epi32(state0, 0x1B);
+  state1 = _mm_shuffle_epi32(state1, 0xB1);
+  _mm_storeu_si128((__m128i *) &st[0], _mm_blend_epi16(tmp, state1, 0xF0));
+  _mm_storeu_si128((__m128i *) &st[4], _mm_alignr_epi8(state1, tmp, 8));
+}
+
+static int sha256_has_shani(void)
+{
+  static int has = -1;
+  unsigned int eax, ebx, ecx, edx;
+
+  if (has < 0) {
+    has = 0;
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)
+        && (ecx & bit_SSSE3) && (ecx & bit_SSE4_1)
+        && __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+      has = (ebx & (1u << 29)) != 0;
+  }
+  return has;
+}
+
+#elif defined(OPAM_SHA_ARM)
+
+static void sha256_blocks_armv8(uint32_t st[8], const uint8_t *p,
+                                size_t blocks)
+{
+  uint32x4_t state0 = vld1q_u32(&st[0]), state1 = vld1q_u32(&st[4]);
+  uint32x4_t abcd, efgh, msg, tmp, w[4];
+  int i;
+
+  for (; blocks > 0; blocks--, p += 64) {
+    abcd = state0;
+    efgh = state1;
+    for (i = 0; i < 4; i++)
+      w[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(p + 16 * i)));
+    for (i = 0; i < 16; i++) {
+      msg = vaddq_u32(w[i & 3], vld1q_u32(&sha256_k[4 * i]));
+      tmp = state0;
+      state0 = vsha256hq_u32(state0, state1, msg);
+      state1 = vsha256h2q_u32(state1, tmp, msg);
+      if (i < 12)
+        w[i & 3] = vsha256su1q_u32(vsha256su0q_u32(w[i & 3], w[(i + 1) & 3]),
+                                   w[(i + 2) & 3], w[(i + 3) & 3]);
+    }
+    state0 = vaddq_u32(state0, abcd);
+    state1 = vaddq_u32(state1, efgh);
+  }
+  vst1q_u32(&st[0], state0);
+  vst1q_u32(&st[4], state1);
+}
+
+#endif
+
+typedef struct {
+  uint32_t state[8];
+  uint64_t length;
+  uint8_t buf[64];
+  size_t buflen;
+  void (*blocks)(uint32_t *, const uint8_t *, size_t);
+} sha256_ctx;
+
+static void sha256_init(sha256_ctx *ctx)
+{
+  static const uint32_t iv[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+  };
+  memcpy(ctx->state, iv, sizeof(iv));
+  ctx->length = 0;
+  ctx->buflen = 0;
+#if defined(OPAM_SHA_X86)
+  ctx->blocks = sha256_has_shani() && !sha256_portable
+    ? sha256_blocks_shani : sha256_blocks_generic;
+#elif defined(OPAM_SHA_ARM)
+  ctx->blocks = sha256_portable ? sha256_blocks_generic : sha256_blocks_armv8;
+#else
+  ctx->blocks = sha256_blocks_generic;
+#endif
+}
+
+static void sha256_update(sha256_ctx *ctx, const uint8_t *p, size_t len)
+{
+  size_t n;
+
+  ctx->length += len;
+  if (ctx->buflen > 0) {
+    n = 64 - ctx->buflen < len ? 64 - ctx->buflen : len;
+    memcpy(ctx->buf + ctx->buflen, p, n);
+    ctx->buflen += n; p += n; len -= n;
+    if (ctx->buflen < 64) return;
+    ctx->blocks(ctx->state, ctx->buf, 1);
+    ctx->buflen = 0;
+  }
+  ctx->blocks(ctx->state, p, len / 64);
+  p += len & ~(size_t) 63;
+  ctx->buflen = len & 63;
+  memcpy(ctx->buf, p, ctx->buflen);
+}
+
+static const char hex_digits[] = "0123456789abcdef";
+
+static void hex_encode(char *hex, const uint8_t *p, size_t len)
+{
+  size_t i;
+
+  for (i = 0; i < len; i++) {
+    hex[2 * i] = hex_digits[p[i] >> 4];
+    hex[2 * i + 1] = hex_digits[p[i] & 15];
+  }
+}
+
+/* Writes the hex-encoded digest, without terminating nul, to [hex] */
+static void sha256_final(sha256_ctx *ctx, char hex[64])
+{
+  uint64_t bits = ctx->length * 8;
+  uint8_t pad[72], digest[32];
+  size_t padlen = (ctx->buflen < 56 ? 56 : 120) - ctx->buflen;
+  int i;
+
+  memset(pad, 0, sizeof(pad));
+  pad[0] = 0x80;
+  for (i = 0; i < 8; i++)
+    pad[padlen + i] = (uint8_t) (bits >> (56 - 8 * i));
+  sha256_update(ctx, pad, padlen + 8);
+  for (i = 0; i < 32; i++)
+    digest[i] = (uint8_t) (ctx->state[i / 4] >> (24 - 8 * (i % 4)));
+  hex_encode(hex, digest, 32);
+}
+
+/* SHA-512 has no widespread hardware support, only the portable version */
+
+static const uint64_t sha512_k[80] = {
+  0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL,
+  0xe9b5dba58189dbbcULL, 0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL,
+  0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL, 0xd807aa98a3030242ULL,
+  0x12835b0145706fbeULL, 0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+  0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL,
+  0xc19bf174cf692694ULL, 0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL,
+  0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL, 0x2de92c6f592b0275ULL,
+  0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+  0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL, 0xb00327c898fb213fULL,
+  0xbf597fc7beef0ee4ULL, 0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL,
+  0x06ca6351e003826fULL, 0x142929670a0e6e70ULL, 0x27b70a8546d22ffcULL,
+  0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+  0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL,
+  0x92722c851482353bULL, 0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL,
+  0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL, 0xd192e819d6ef5218ULL,
+  0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+  0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL, 0x2748774cdf8eeb99ULL,
+  0x34b0bcb5e19b48a8ULL, 0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL,
+  0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL, 0x748f82ee5defb2fcULL,
+  0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+  0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL,
+  0xc67178f2e372532bULL, 0xca273eceea26619cULL, 0xd186b8c721c0c207ULL,
+  0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL, 0x06f067aa72176fbaULL,
+  0x0a637dc5a2c898a6ULL, 0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+  0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL,
+  0x431d67c49c100d4cULL, 0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL,
+  0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL
+};
+
+#define ROTR64(x, n) (((x) >> (n)) | ((x) << (64 - (n))))
+
+typedef struct {
+  uint64_t state[8];
+  uint64_t length;
+  uint8_t buf[128];
+  size_t buflen;
+} sha512_ctx;
+
+static void sha512_blocks(uint64_t st[8], const uint8_t *p, size_t blocks)
+{
+  uint64_t w[80], a, b, c, d, e, f, g, h, t1, t2;
+  int i, j;
+
+  for (; blocks > 0; blocks--, p += 128) {
+    for (i = 0; i < 16; i++)
+      for (w[i] = 0, j = 0; j < 8; j++)
+        w[i] = w[i] << 8 | p[8*i+j];
+    for (i = 16; i < 80; i++) {
+      t1 = ROTR64(w[i-2], 19) ^ ROTR64(w[i-2], 61) ^ (w[i-2] >> 6);
+      t2 = ROTR64(w[i-15], 1) ^ ROTR64(w[i-15], 8) ^ (w[i-15] >> 7);
+      w[i] = w[i-16] + t2 + w[i-7] + t1;
+    }
+    a = st[0]; b = st[1]; c = st[2]; d = st[3];
+    e = st[4]; f = st[5]; g = st[6]; h = st[7];
+    for (i = 0; i < 80; i++) {
+      t1 = h + (ROTR64(e, 14) ^ ROTR64(e, 18) ^ ROTR64(e, 41))
+        + ((e & f) ^ (~e & g)) + sha512_k[i] + w[i];
+      t2 = (ROTR64(a, 28) ^ ROTR64(a, 34) ^ ROTR64(a, 39))
+        + ((a & b) ^ (a & c) ^ (b & c));
+      h = g; g = f; f = e; e = d + t1;
+      d = c; c = b; b = a; a = t1 + t2;
+    }
+    st[0] += a; st[1] += b; st[2] += c; st[3] += d;
+    st[4] += e; st[5] += f; st[6] += g; st[7] += h;
+  }
+}
+
+static void sha512_init(sha512_ctx *ctx)
+{
+  static const uint64_t iv[8] = {
+    0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL,
+    0xa54ff53a5f1d36f1ULL, 0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL,
+    0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL
+  };
+  memcpy(ctx->state, iv, sizeof(iv));
+  ctx->length = 0;
+  ctx->buflen = 0;
+}
+
+static void sha512_update(sha512_ctx *ctx, const uint8_t *p, size_t len)
+{
+  size_t n;
+
+  ctx->length += len;
+  if (ctx->buflen > 0) {
+    n = 128 - ctx->buflen < len ? 128 - ctx->buflen : len;
+    memcpy(ctx->buf + ctx->buflen, p, n);
+    ctx->buflen += n; p += n; len -= n;
+    if (ctx->buflen < 128) return;
+    sha512_blocks(ctx->state, ctx->buf, 1);
+    ctx->buflen = 0;
+  }
+  sha512_blocks(ctx->state, p, len / 128);
+  p += len & ~(size_t) 127;
+  ctx->buflen = len & 127;
+  memcpy(ctx->buf, p, ctx->buflen);
+}
+
+/* Lengths beyond 2^64 bits are not supported */
+static void sha512_final(sha512_ctx *ctx, char hex[128])
+{
+  uint64_t bits = ctx->length * 8;
+  uint8_t pad[144], digest[64];
+  size_t padlen = (ctx->buflen < 112 ? 112 : 240) - ctx->buflen;
+  int i;
+
+  memset(pad, 0, sizeof(pad));
+  pad[0] = 0x80;
+  for (i = 0; i < 8; i++)
+    pad[padlen + 8 + i] = (uint8_t) (bits >> (56 - 8 * i));
+  sha512_update(ctx, pad, padlen + 16);
+  for (i = 0; i < 64; i++)
+    digest[i] = (uint8_t) (ctx->state[i / 8] >> (56 - 8 * (i % 8)));
+  hex_encode(hex, digest, 64);
+}
+
+/* Computes the requested digests in a single pass over the data */
+typedef struct {
+  int md5, sha256, sha512;
+  struct MD5Context md5_ctx;
+  sha256_ctx sha256_ctx;
+  sha512_ctx sha512_ctx;
+} hash_ctx;
+
+static void hash_init(hash_ctx *ctx, int md5, int sha256, int sha512)
+{
+  ctx->md5 = md5;
+  ctx->sha256 = sha256;
+  ctx->sha512 = sha512;
+  if (md5) caml_MD5Init(&ctx->md5_ctx);
+  if (sha256) sha256_init(&ctx->sha256_ctx);
+  if (sha512) sha512_init(&ctx->sha512_ctx);
+}
+
+static void hash_update(hash_ctx *ctx, const uint8_t *p, size_t len)
+{
+  size_t n;
+
+  /* Chunks are fed to all the digests while they are still in cache */
+  for (; len > 0; p += n, len -= n) {
+    n = len < 65536 ? len : 65536;
+    if (ctx->md5) caml_MD5Update(&ctx->md5_ctx, (unsigned char *) p, n);
+    if (ctx->sha256) sha256_update(&ctx->sha256_ctx, p, n);
+    if (ctx->sha512) sha512_update(&ctx->sha512_ctx, p, n);
+  }
+}
+
+#ifdef _WIN32
+#define hash_read _read
+typedef int hash_ssize_t;
+#else
+#define hash_read read
+typedef ssize_t hash_ssize_t;
+#endif
+
+/* Returns 0, or the errno of the failing call */
+static int hash_fd(int fd, hash_ctx *ctx)
+{
+  uint8_t buf[65536];
+  hash_ssize_t n;
+
+#ifdef POSIX_FADV_SEQUENTIAL
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+  for (;;) {
+    n = hash_read(fd, buf, sizeof(buf));
+    if (n > 0)
+      hash_update(ctx, buf, (size_t) n);
+    else if (n == 0)
+      return 0;
+    else if (errno != EINTR)
+      return errno;
+  }
+}
+
+/* Hashes the file at [path], raising [Unix_error] if it can't be read */
+static void hash_path(value path, hash_ctx *ctx)
+{
+  char_os *p;
+  int fd, err = 0;
+
+  caml_unix_check_path(path, "open");
+  p = caml_stat_strdup_to_os(String_val(path));
+  caml_enter_blocking_section();
+#ifdef _WIN32
+  fd = _wopen(p, _O_RDONLY | _O_BINARY);
+#else
+  fd = open(p, O_RDONLY | O_CLOEXEC);
+#endif
+  if (fd < 0) {
+    err = errno;
+  } else {
+    err = hash_fd(fd, ctx);
+#ifdef _WIN32
+    _close(fd);
+#else
+    close(fd);
+#endif
+  }
+  caml_leave_blocking_section();
+  caml_stat_free(p);
+  if (err != 0) {
+    errno = err;
+    caml_uerror(fd < 0 ? "open" : "read", path);
+  }
+}
+
+CAMLprim value opam_sha256_file(value path)
+{
+  CAMLparam1(path);
+  CAMLlocal1(result);
+  hash_ctx ctx;
+  char hex[64];
+
+  hash_init(&ctx, 0, 1, 0);
+  hash_path(path, &ctx);
+  sha256_final(&ctx.sha256_ctx, hex);
+  result = caml_alloc_initialized_string(64, hex);
+  CAMLreturn(result);
+}
+
+CAMLprim value opam_hash_file(value path, value md5, value sha256,
+                              value sha512)
+{
+  CAMLparam4(path, md5, sha256, sha512);
+  CAMLlocal4(result, md5_hex, sha256_hex, sha512_hex);
+  hash_ctx ctx;
+  unsigned char md5_digest[16];
+  char hex[128];
+
+  hash_init(&ctx, Bool_val(md5), Bool_val(sha256), Bool_val(sha512));
+  hash_path(path, &ctx);
+  md5_hex = sha256_hex = sha512_hex = caml_alloc_string(0);
+  if (ctx.md5) {
+    caml_MD5Final(md5_digest, &ctx.md5_ctx);
+    hex_encode(hex, md5_digest, 16);
+    md5_hex = caml_alloc_initialized_string(32, hex);
+  }
+  if (ctx.sha256) {
+    sha256_final(&ctx.sha256_ctx, hex);
+    sha256_hex = caml_alloc_initialized_string(64, hex);
+  }
+  if (ctx.sha512) {
+    sha512_final(&ctx.sha512_ctx, hex);
+    sha512_hex = caml_alloc_initialized_string(128, hex);
+  }
+  result = caml_alloc_tuple(3);
+  Store_field(result, 0, md5_hex);
+  Store_field(result, 1, sha256_hex);
+  Store_field(result, 2, sha512_hex);
+  CAMLreturn(result);
+}
+
+CAMLprim value opam_sha256_force_portable(value portable)
+{
+  sha256_portable = Bool_val(portable);
+  return Val_unit;
+}
+
+CAMLprim value opam_sha256_string(value str)
+{
+  CAMLparam1(str);
+  CAMLlocal1(result);
+  sha256_ctx ctx;
+  char hex[64];
+
+  sha256_init(&ctx);
+  sha256_update(&ctx, (const uint8_t *) String_val(str),
+                caml_string_length(str));
+  sha256_final(&ctx, hex);
+  result = caml_alloc_initialized_string(64, hex);
+  CAMLreturn(result);
+}
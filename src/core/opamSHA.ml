@@ -9,7 +9,7 @@
 (**************************************************************************)
 
 let sha1_file file = Sha1.to_hex (Sha1.file file)
-let sha256_file file = Sha256.to_hex (Sha256.file file)
+let sha256_file = OpamStubs.sha256_file
 let sha512_file file = Sha512.to_hex (Sha512.file file)
 let hash_file = function
   | `SHA1 -> sha1_file
@@ -17,7 +17,7 @@ let hash_file = function
   | `SHA512 -> sha512_file
 
 let sha1_string str = Sha1.to_hex (Sha1.string str)
-let sha256_string str = Sha256.to_hex (Sha256.string str)
+let sha256_string = OpamStubs.sha256_string
 let sha512_string str = Sha512.to_hex (Sha512.string str)
 let hash_string = function
   | `SHA1 -> sha1_string
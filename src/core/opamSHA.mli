@@ -8,8 +8,9 @@
 (*                                                                        *)
 (**************************************************************************)
 
-(** Pure OCaml implementation of SHA256/512 hashing functions. The hash is
-    returned as an hex string. *)
+(** SHA1/256/512 hashing functions. The hash is returned as an hex string.
+    SHA256, the default kind of opam checksums, uses the C kernels of
+    {!OpamStubs.sha256_file}, hardware-accelerated where available. *)
 
 val sha1_file: string -> string
 
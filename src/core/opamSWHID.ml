@@ -10,7 +10,8 @@
 
 module SWHO = Swhid_core.Object
 module SWH_ID = SWHO.Core_identifier
-module SWH_Compute = Swhid_core.Compute
+
+let log fmt = OpamConsole.log "SWHID" fmt
 
 type t = SWH_ID.t
 
@@ -67,47 +68,137 @@ let to_url swh =
 
 (** Identifier computing *)
 
-module SHA1 = struct
-  let digest_string_to_hex = OpamSHA.sha1_string
-end
-module OS = struct
-
-  let contents dir =
-    try Some (OpamSystem.ls dir)
-    with _ -> None
-
-  let typ name =
-    try
-      Some (if Sys.is_directory name then SWH_Compute.Dir else SWH_Compute.File)
-    with _ -> None
-
-  let read_file name =
-    try Some (OpamSystem.read name)
-    with OpamSystem.File_not_found _ -> None
-
-    (*
-      - [0o120000] if [f] is a symlink
-      - [0o040000] if [f] is a directory
-      - [0o100755] if [f] is an executable file
-      - [0o100644] if [f] is a regular file *)
-  let permissions name =
-    if not (Sys.file_exists name) then raise Not_found else
-    let { Unix.st_kind; _ } = Unix.lstat name in
-    match st_kind with
-    | Unix.S_DIR -> Some 0o040000
-    | Unix.S_LNK -> Some 0o120000
-    | Unix.S_REG ->
-      Some (if OpamSystem.is_exec name then 0o100755 else 0o100644)
-    | Unix.S_CHR | Unix.S_BLK | Unix.S_FIFO | Unix.S_SOCK -> None
-
-  let base name = OpamFilename.(Base.to_string (basename (of_string name)))
-
-end
-
-module Compute = SWH_Compute.Make(SHA1)(OS)
+(* Directory identifiers are git tree hashes (with empty directories kept):
+   blobs are hashed with streaming SHA-1 contexts, in parallel when
+   {!OpamCompute} allows it, and the trees are then hashed from the bottom
+   up. *)
+
+type node =
+  | File of string * int * float (* path, size, mtime *)
+  | Link of string (* target *)
+  | Tree of (string * int * string * node) list
+  (* sort key, permissions, name, node *)
+
+exception Special_file of string
+
+let git_object_digest kind contents =
+  let ctx = Sha1.init () in
+  Sha1.update_string ctx
+    (Printf.sprintf "%s %d\000" kind (String.length contents));
+  Sha1.update_string ctx contents;
+  Sha1.finalize ctx
+
+let blob_digest path size =
+  let ctx = Sha1.init () in
+  Sha1.update_string ctx (Printf.sprintf "blob %d\000" size);
+  let ic = open_in_bin path in
+  OpamStd.Exn.finally (fun () -> close_in ic) @@ fun () ->
+  let buf = Bytes.create 65536 in
+  let rec aux read =
+    match input ic buf 0 (Bytes.length buf) with
+    | 0 -> read
+    | n ->
+      Sha1.update_substring ctx (Bytes.unsafe_to_string buf) 0 n;
+      aux (read + n)
+  in
+  if aux 0 <> size then failwith (path ^ " changed while hashing");
+  Sha1.to_bin (Sha1.finalize ctx)
+
+(* Blob digests of already hashed files, by path, size and mtime *)
+let blob_cache : (string * int * float, string) Hashtbl.t = Hashtbl.create 57
+
+(* Returns the entries of [dir], with the files below it that are not in the
+   cache *)
+let scan dir =
+  let rec aux dir to_hash =
+    let names = Sys.readdir dir in
+    Array.fold_left (fun (entries, to_hash) name ->
+        let path = Filename.concat dir name in
+        let st = Unix.lstat path in
+        match st.Unix.st_kind with
+        | Unix.S_DIR ->
+          let sub, to_hash = aux path to_hash in
+          (name ^ "/", 0o040000, name, Tree sub) :: entries, to_hash
+        | Unix.S_LNK ->
+          (name, 0o120000, name, Link (Unix.readlink path)) :: entries,
+          to_hash
+        | Unix.S_REG ->
+          let perm =
+            if st.Unix.st_perm land 0o100 <> 0 then 0o100755 else 0o100644
+          in
+          let file = path, st.Unix.st_size, st.Unix.st_mtime in
+          let to_hash =
+            if Hashtbl.mem blob_cache file then to_hash else file :: to_hash
+          in
+          (name, perm, name, File file) :: entries, to_hash
+        | Unix.S_CHR | Unix.S_BLK | Unix.S_FIFO | Unix.S_SOCK ->
+          raise (Special_file path))
+      ([], to_hash) names
+  in
+  aux dir []
+
+(* Below this, spawning a new computation costs more than it saves *)
+let min_files_per_worker = 16
+
+(* Hashes the given files, spreading them over the available domains, and
+   adds their digests to the cache *)
+let hash_files files =
+  let workers =
+    min OpamCompute.max_parallel (List.length files / min_files_per_worker)
+  in
+  let batches = Array.make (workers + 1) [] in
+  List.iteri (fun i file ->
+      let b = i mod (workers + 1) in
+      batches.(b) <- file :: batches.(b))
+    (List.sort (fun (_, s1, _) (_, s2, _) -> compare s2 s1) files);
+  let hash_batch batch =
+    List.map (fun (path, size, _ as file) -> file, blob_digest path size)
+      batch
+  in
+  let spawned =
+    Array.map (fun batch -> OpamCompute.spawn (fun () -> hash_batch batch))
+      (Array.sub batches 1 workers)
+  in
+  let local = try Ok (hash_batch batches.(0)) with e -> Error e in
+  let results =
+    local ::
+    Array.to_list
+      (Array.map (fun c -> try Ok (OpamCompute.join c) with e -> Error e)
+         spawned)
+  in
+  List.iter (function
+      | Ok digests ->
+        List.iter (fun (file, digest) -> Hashtbl.replace blob_cache file digest)
+          digests
+      | Error e -> raise e)
+    results
+
+let rec tree_digest entries =
+  let entries =
+    List.sort (fun (k1, _, _, _) (k2, _, _, _) -> compare k1 k2) entries
+  in
+  let b = Buffer.create 1024 in
+  List.iter (fun (_, perm, name, node) ->
+      Printf.bprintf b "%o %s\000" perm name;
+      Buffer.add_string b
+        (match node with
+         | File file -> Hashtbl.find blob_cache file
+         | Link target -> Sha1.to_bin (git_object_digest "blob" target)
+         | Tree entries -> Sha1.to_bin (tree_digest entries)))
+    entries;
+  git_object_digest "tree" (Buffer.contents b)
 
 let compute dir =
-  match Compute.directory_identifier_deep
-          (OpamFilename.Dir.to_string dir) with
-  | Error _ ->  None
-  | Ok identifier -> Some (SWHO.Hash.to_string (SWHO.get_hash identifier))
+  let dir = OpamFilename.Dir.to_string dir in
+  try
+    let entries, to_hash = scan dir in
+    hash_files to_hash;
+    Some (Sha1.to_hex (tree_digest entries))
+  with
+  | Special_file f ->
+    log "can't compute SWHID of %s: %s is a special file" dir f;
+    None
+  | e ->
+    OpamStd.Exn.fatal e;
+    log "can't compute SWHID of %s: %s" dir (Printexc.to_string e);
+    None
@@ -25,5 +25,9 @@ val of_url: OpamUrl.t -> t option
     https://swhid.opam.ocaml.org/swhi *)
 val to_url: t -> OpamUrl.t
 
-(** Compute and SWH identifier from the given directory *)
+(** Compute and SWH identifier from the given directory. Files are hashed
+    without being loaded in memory, in parallel when possible (see
+    {!OpamCompute}); their digests are kept for the rest of the run, by path,
+    size and modification time, so that hashing the same tree again only
+    rescans it. *)
 val compute: OpamFilename.Dir.t -> string option
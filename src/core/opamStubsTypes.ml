@@ -128,3 +128,38 @@ external is_executable : string -> bool = "opam_is_executable"
 external nproc : unit -> nativeint = "opam_nproc"
 (** Returns the number of logical processors of the current machine.
     Any value below [1] is an error. *)
+
+external readdir_kinds : string -> (string * bool) list = "opam_readdir_kinds"
+(** Lists the entries of a directory, except [.] and [..], in no particular
+    order, each with whether it is a directory. Symbolic links are followed,
+    and dangling ones omitted. The types returned by readdir(3) are used when
+    available, to avoid a stat(2) per entry; on Windows, links are not followed
+    but links to directories are reported as directories.
+    @raise Unix.Unix_error if the directory can't be read *)
+
+external clone_file : string -> string -> bool = "opam_clone_file"
+(** [clone_file src dst] makes [dst], which must not exist, a copy-on-write
+    clone of the regular file [src] (reflink), with the same permissions.
+    Returns [false], without creating [dst], where the platform or the file
+    system doesn't support it: only Linux (FICLONE, e.g. on Btrfs or XFS) and
+    macOS (clonefile, on APFS) do. *)
+
+external sha256_file : string -> string = "opam_sha256_file"
+(** Hex-encoded SHA-256 digest of the given file, using the SHA instructions of
+    the CPU when available.
+    @raise Unix.Unix_error if the file can't be read *)
+
+external sha256_string : string -> string = "opam_sha256_string"
+(** Hex-encoded SHA-256 digest of the given string, see {!sha256_file} *)
+
+external sha256_force_portable : bool -> unit = "opam_sha256_force_portable"
+(** Disables (or re-enables) the hardware-accelerated SHA-256 kernels, so that
+    the tests can check the portable one on any machine *)
+
+external hash_file :
+  string -> md5:bool -> sha256:bool -> sha512:bool -> string * string * string
+  = "opam_hash_file"
+(** Hex-encoded MD5, SHA-256 and SHA-512 digests of the given file, computed
+    in a single read of the file. The digests that weren't requested are
+    returned as empty strings.
+    @raise Unix.Unix_error if the file can't be read *)
@@ -374,11 +374,15 @@ let directories_strict =
 let directories_with_links =
   list (fun f -> try Sys.is_directory f with Sys_error _ -> false)
 
+let dir_entries dir =
+  try List.sort compare (OpamStubs.readdir_kinds dir)
+  with Unix.Unix_error ((Unix.ENOENT | Unix.ENOTDIR), _, _) -> []
+
 let rec_files dir =
   let rec aux accu dir =
-    let d = directories_with_links dir in
-    let f = files_with_links dir in
-    List.fold_left aux (f @ accu) d in
+    let d, f = List.partition snd (dir_entries dir) in
+    let full = List.map (fun (name, _) -> Filename.concat dir name) in
+    List.fold_left aux (full f @ accu) (full d) in
   aux [] dir
 
 let files dir =
@@ -697,6 +701,32 @@ let copy_dir = copy_dir_t ~except_vcs:false ~with_log:true
 let copy_dir_except_vcs = copy_dir_t ~except_vcs:true ~with_log:true
 let copy_file = copy_file_t ~with_log:true
 
+let clone_file src dst =
+  if file_or_symlink_exists dst then remove_file dst;
+  mkdir (Filename.dirname dst);
+  if not (OpamStubs.clone_file src dst) then copy_file_aux ~src ~dst ()
+
+let clone_dir ?(except=[]) src dst_dir =
+  log "clonedir %s -> %s" src dst_dir;
+  let rec aux ~except src dst_dir =
+    mkdir dst_dir;
+    List.iter (fun file ->
+        let src = Filename.concat src file in
+        let dst = Filename.concat dst_dir file in
+        match (Unix.lstat src).Unix.st_kind with
+        | Unix.S_REG -> clone_file src dst
+        | Unix.S_DIR -> aux ~except:[] src dst
+        | Unix.S_LNK ->
+          link_t ~except_vcs:false ~with_log:false (Unix.readlink src) dst
+        | Unix.(S_CHR | S_BLK | S_FIFO | S_SOCK) ->
+          log "clonedir: skipping special file %s" src
+        | exception Unix.(Unix_error (ENOENT, _, _)) when Sys.win32 ->
+          OpamConsole.warning "Warning: cannot copy %s to %s" src dst_dir)
+      (List.filter (fun f -> not (List.mem f except))
+         (get_files_t ~except_vcs:false src))
+  in
+  aux ~except src dst_dir
+
 let mv src dst =
   if file_or_symlink_exists dst then remove_file dst;
   mkdir (Filename.dirname dst);
@@ -1206,6 +1236,22 @@ and flock: 'a. ([< lock_flag ] as 'a) -> ?dontblock:bool -> string -> lock =
     flock_update flag ?dontblock lock;
     lock
 
+let try_flock flag file =
+  let flag = (flag :> actual_lock_flag) in
+  mkdir (Filename.dirname file);
+  let rdflag = if flag = `Lock_write then Unix.O_RDWR else Unix.O_RDONLY in
+  let fd = Unix.openfile file Unix.([O_CREAT; O_CLOEXEC; O_SHARE_DELETE; rdflag]) 0o666 in
+  match Unix.lockf fd (unix_lock_op ~dontblock:true flag) 0 with
+  | () ->
+    log "LOCK %s (%a => %a)" ~level:2 file
+      (slog string_of_lock_kind) `Lock_none
+      (slog string_of_lock_kind) (flag :> lock_flag);
+    Hashtbl.add locks fd ();
+    Some { fd = Some fd; file; kind = (flag :> lock_flag) }
+  | exception Unix.Unix_error ((Unix.EAGAIN | Unix.EACCES), _, _) ->
+    Unix.close fd;
+    None
+
 let funlock lock = flock_update `Lock_none lock
 
 let get_lock_flag lock = lock.kind
@@ -1612,7 +1658,38 @@ let patch ~allow_unclean ?patch_filename ~dir diffs =
         patch_info_path;
     file
   in
-  let patch ~file content diff =
+  (* The diffs are all applied in memory first, on top of the files on disk:
+     [planned] holds the new contents of the files (with the permissions to
+     give them), or [None] for the files to remove, and [order] the files in
+     the order they were first touched. *)
+  let planned = Hashtbl.create 53 in
+  let order = ref [] in
+  let cleanup_dirs = ref [] in
+  let plan file change =
+    if not (Hashtbl.mem planned file) then order := file :: !order;
+    Hashtbl.replace planned file change
+  in
+  let exists file =
+    match Hashtbl.find_opt planned file with
+    | Some change -> change <> None
+    | None -> Sys.file_exists file
+  in
+  let contents file =
+    match Hashtbl.find_opt planned file with
+    | Some (Some (content, perm)) -> content, perm
+    | Some None -> raise (File_not_found file)
+    | None ->
+      log ~level:5 "read %s" file;
+      let ic =
+        try open_in_bin file
+        with Sys_error _ -> raise (File_not_found file)
+      in
+      let perm = (Unix.fstat (Unix.descr_of_in_channel ic)).Unix.st_perm in
+      let content = string_of_channel ic in
+      close_in ic;
+      content, perm
+  in
+  let patch ~file ~perm content diff =
     (* NOTE: The None case returned by [Patch.patch] is only returned
        if [diff = Patch.Delete _]. This sub-function is not called in
        this case so we [assert false] instead. *)
@@ -1625,7 +1702,7 @@ let patch ~allow_unclean ?patch_filename ~dir diffs =
     | exception _ ->
       match Patch.patch ~cleanly:false content diff with
       | Some x ->
-        Option.iter (write (file^".orig")) content;
+        Option.iter (fun c -> plan (file^".orig") (Some (c, perm))) content;
         x
       | None -> assert false (* See NOTE above *)
       | exception _ ->
@@ -1638,31 +1715,67 @@ let patch ~allow_unclean ?patch_filename ~dir diffs =
     | Patch.Edit (file1, file2) ->
       let file1 = get_path file1 in
       let file2 = get_path file2 in
-      let file1_exists = Sys.file_exists file1 in
+      let file1_exists = exists file1 in
       (* That seems to be the GNU patch behaviour *)
       let file = if file1_exists then file1 else file2 in
-      let content = read file in
-      let content = patch ~file:file (Some content) diff in
-      write file content;
+      let content, perm = contents file in
+      let content = patch ~file ~perm (Some content) diff in
+      plan file (Some (content, perm));
       if file1_exists && file1 <> (file2 : string) then
-        rmdir_cleanup (Filename.dirname file1)
+        cleanup_dirs := Filename.dirname file1 :: !cleanup_dirs
     | Patch.Delete file | Patch.Git_ext (file, _, Patch.Delete_only) ->
       let file = get_path file in
-      remove_file_t ~with_log:false file;
-      rmdir_cleanup (Filename.dirname file)
+      if not (exists file) then
+        internal_error "Cannot remove %s (not found)." file;
+      plan file None;
+      cleanup_dirs := Filename.dirname file :: !cleanup_dirs
     | Patch.Create file | Patch.Git_ext (_, file, Patch.Create_only) ->
       let file = get_path file in
-      let content = patch ~file None diff in
-      write file content
+      let content = patch ~file ~perm:0o666 None diff in
+      plan file (Some (content, 0o666))
     | Patch.Git_ext (_, _, Patch.Rename_only (src, dst)) ->
       let src = get_path src in
       let dst = get_path dst in
-      mv src dst;
+      let change = contents src in
+      plan src None;
+      plan dst (Some change);
       let dirname_src = Filename.dirname src in
       if dirname_src <> (Filename.dirname dst : string) then
-        rmdir_cleanup dirname_src
+        cleanup_dirs := dirname_src :: !cleanup_dirs
   in
-  List.iter apply diffs
+  List.iter apply diffs;
+  (* Then the new contents are written to temporary files next to their
+     targets, and only renamed over them once they all have been written, so
+     that failing part-way leaves the directory unchanged. The caller is
+     expected to hold a lock on [dir]. *)
+  let order = List.rev !order in
+  let temp_files = ref [] in
+  (try
+     List.iter (fun file ->
+         match Hashtbl.find planned file with
+         | None -> ()
+         | Some (content, perms) ->
+           let temp_dir = Filename.dirname file in
+           mkdir temp_dir;
+           log ~level:5 "write %s" file;
+           let tmp, oc =
+             Filename.open_temp_file ~mode:[Open_binary] ~perms ~temp_dir
+               "opam-patch" ".tmp"
+           in
+           temp_files := (tmp, file) :: !temp_files;
+           try output_string oc content; close_out oc
+           with e -> close_out_noerr oc; raise e)
+       order
+   with e ->
+     OpamStd.Exn.finalise e @@ fun () ->
+     List.iter (fun (tmp, _) -> remove_file_t ~with_log:false tmp)
+       !temp_files);
+  List.iter (fun (tmp, file) -> Sys.rename tmp file) (List.rev !temp_files);
+  List.iter (fun file ->
+      if Hashtbl.find planned file = None && file_or_symlink_exists file then
+        remove_file_t ~with_log:false file)
+    order;
+  List.iter rmdir_cleanup (List.rev !cleanup_dirs)
 
 let parse_patch ~dir ~file =
   if not (Sys.file_exists file) then
@@ -68,6 +68,16 @@ val mk_unique_dir: dir:string -> ?prefix:string -> unit -> string
     if it is a link. *)
 val copy_file: string -> string -> unit
 
+(** Like [copy_file], without logging, but makes [dst] a copy-on-write clone of
+    [src] (reflink) where the file system supports it, which is then almost
+    free. Falls back to a plain copy otherwise. *)
+val clone_file: string -> string -> unit
+
+(** Like [copy_dir], but cloning the files with {!clone_file}. Symbolic links
+    are copied as is, and special files are skipped, as well as the entries of
+    [src] (not of its sub-directories) whose names are listed in [except]. *)
+val clone_dir: ?except:string list -> string -> string -> unit
+
 (** [copy_dir src dst] copies the contents of directory [src] into directory
     [dst], creating it if necessary, merging directory contents and ovewriting
     files otherwise *)
@@ -172,6 +182,11 @@ val ls: string -> string list
     Links simulating directory are ignored, others links are returned. *)
 val files_with_links: string -> string list
 
+(** Returns the names of the entries of the given directory, sorted, each
+    with whether it is a directory (following links). Doesn't need to stat
+    each entry on most systems. Returns [[]] if the directory doesn't exist. *)
+val dir_entries: string -> (string * bool) list
+
 (** [rec_files dir] returns the list of all files in [dir],
     recursively.
     Links behaving like directory are crossed. *)
@@ -329,6 +344,11 @@ val flock: [< lock_flag ] -> ?dontblock:bool -> string -> lock
     [flock]. *)
 val flock_update: [< lock_flag ] -> ?dontblock:bool -> lock -> unit
 
+(** Like [flock], but returns [None] instead of waiting when the lock is held
+    by another process. Note that locks are per-process: this never fails on a
+    file that the current process already locked. *)
+val try_flock: [< actual_lock_flag ] -> string -> lock option
+
 (** Releases an acquired lock (equivalent to [flock_update `Lock_none]) *)
 val funlock: lock -> unit
 
@@ -353,7 +373,13 @@ val get_lock_fd: lock -> Unix.file_descr
 
     @param allow_unclean decides if applying a patch on a directory which
     differs slightly from the one described in the patch file is allowed.
-    Allowing unclean applications imitates the default behaviour of GNU Patch. *)
+    Allowing unclean applications imitates the default behaviour of GNU Patch.
+
+    All the diffs are applied in memory before any file of [dir] is modified,
+    and the new files are then renamed into place: if a diff doesn't apply, or
+    writing fails, [dir] is left unchanged (apart from the [.orig] and [.rej]
+    files of an unclean application). Files are not locked individually, the
+    caller should hold a lock on [dir] if needed. *)
 val patch:
   allow_unclean:bool -> ?patch_filename:string -> dir:string
   -> Patch.t list -> unit
@@ -0,0 +1,89 @@
+(**************************************************************************)
+(*                                                                        *)
+(*    Copyright 2026 OCamlPro                                             *)
+(*                                                                        *)
+(*  All rights reserved. This file is distributed under the terms of the  *)
+(*  GNU Lesser General Public License version 2.1, with the special       *)
+(*  exception on linking described in the file LICENSE.                   *)
+(*                                                                        *)
+(**************************************************************************)
+
+let is_enabled = ref false
+
+let enabled () = !is_enabled
+
+let events = Buffer.create 4096
+
+let start_time = Unix.gettimeofday ()
+
+let pid = OpamStubs.getpid ()
+
+(* Timestamps are in microseconds *)
+let ts t = (t -. start_time) *. 1e6
+
+let add_string b s =
+  Buffer.add_char b '"';
+  String.iter (function
+      | '"' -> Buffer.add_string b "\\\""
+      | '\\' -> Buffer.add_string b "\\\\"
+      | c when c < ' ' -> Printf.bprintf b "\\u%04x" (Char.code c)
+      | c -> Buffer.add_char b c)
+    s;
+  Buffer.add_char b '"'
+
+(* Adds an event, given its name, category, phase and the extra fields *)
+let add_event ~cat ~ph name fields =
+  if Buffer.length events > 0 then Buffer.add_string events ",\n";
+  Buffer.add_string events "{\"name\":";
+  add_string events name;
+  Buffer.add_string events ",\"cat\":";
+  add_string events cat;
+  Printf.bprintf events ",\"ph\":\"%c\",\"pid\":%d," ph pid;
+  fields events;
+  Buffer.add_char events '}'
+
+let write file =
+  try
+    let oc = open_out_bin file in
+    output_string oc "{\"traceEvents\":[\n";
+    Buffer.output_buffer oc events;
+    output_string oc "\n]}\n";
+    close_out oc
+  with Sys_error e ->
+    OpamConsole.warning "Could not write the trace to %s: %s" file e
+
+let enable file =
+  if not !is_enabled then
+    (is_enabled := true;
+     at_exit (fun () -> write file))
+
+let complete ?(cat="opam") ?(tid=0) ~start name =
+  if !is_enabled then
+    let now = Unix.gettimeofday () in
+    add_event ~cat ~ph:'X' name @@ fun b ->
+    Printf.bprintf b "\"tid\":%d,\"ts\":%.0f,\"dur\":%.0f"
+      tid (ts start) ((now -. start) *. 1e6)
+
+let span ?cat name f =
+  if not !is_enabled then f () else
+  let start = Unix.gettimeofday () in
+  match f () with
+  | r -> complete ?cat ~start name; r
+  | exception e -> complete ?cat ~start name; raise e
+
+let async ~ph ?(cat="opam") ~id name =
+  if !is_enabled then
+    let now = Unix.gettimeofday () in
+    add_event ~cat ~ph name @@ fun b ->
+    Printf.bprintf b "\"tid\":0,\"id\":%d,\"ts\":%.0f" id (ts now)
+
+let async_begin ?cat ~id name = async ~ph:'b' ?cat ~id name
+
+let async_end ?cat ~id name = async ~ph:'e' ?cat ~id name
+
+let counter name value =
+  if !is_enabled then
+    let now = Unix.gettimeofday () in
+    add_event ~cat:"opam" ~ph:'C' name @@ fun b ->
+    Printf.bprintf b "\"tid\":0,\"ts\":%.0f,\"args\":{\"value\":%d}"
+      (ts now) value
@@ -0,0 +1,46 @@
+(**************************************************************************)
+(*                                                                        *)
+(*    Copyright 2026 OCamlPro                                             *)
+(*                                                                        *)
+(*  All rights reserved. This file is distributed under the terms of the  *)
+(*  GNU Lesser General Public License version 2.1, with the special       *)
+(*  exception on linking described in the file LICENSE.                   *)
+(*                                                                        *)
+(**************************************************************************)
+
+(** Tracing of the execution of opam, exported in the Chrome trace event
+    format, that can be loaded in [chrome://tracing] or
+    {{:https://ui.perfetto.dev}Perfetto}. Enabled by setting [OPAMTRACE] to
+    the output file (see {!OpamClientConfig.opam_init}).
+
+    When tracing is disabled, the functions of this module return immediately
+    and record nothing, and {!span} just calls its function. Their arguments
+    are still evaluated, and the function given to {!span} still allocated,
+    so guard the computation of dynamic names or values with {!enabled}.
+
+    Events are recorded in a buffer that is not protected against concurrent
+    accesses: they must only be recorded from the main domain, and not from
+    the computations run by {!OpamCompute}. *)
+
+(** Whether tracing is enabled *)
+val enabled: unit -> bool
+
+(** Starts recording events, to be written to the given file at exit *)
+val enable: string -> unit
+
+(** [span ?cat name f] records the execution of [f ()], on the main track *)
+val span: ?cat:string -> string -> (unit -> 'a) -> 'a
+
+(** [complete ?cat ?tid ~start name] records a span that started at [start]
+    (as returned by [Unix.gettimeofday]) and ends now, on track [tid] *)
+val complete: ?cat:string -> ?tid:int -> start:float -> string -> unit
+
+(** Begins an asynchronous span, for tasks that overlap with others, e.g.
+    parallel jobs. The span is identified by [cat], [id] and [name] *)
+val async_begin: ?cat:string -> id:int -> string -> unit
+
+(** Ends the asynchronous span opened by {!async_begin} *)
+val async_end: ?cat:string -> id:int -> string -> unit
+
+(** Records the current value of a counter *)
+val counter: string -> int -> unit
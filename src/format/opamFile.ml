@@ -3555,6 +3555,26 @@ module OPAM = struct
   include OPAMSyntax
   include SyntaxFile(OPAMSyntax)
 
+  let skip_items skip =
+    let skipped name = OpamStd.List.mem String.equal name skip in
+    Pp.pp
+      (fun ~pos:_ opamfile ->
+         { opamfile with
+           file_contents =
+             List.filter (fun item -> match item.pelem with
+                 | Variable (name, _) -> not (skipped name.pelem)
+                 | Section s -> not (skipped s.section_kind.pelem))
+               opamfile.file_contents })
+      (fun opamfile -> opamfile)
+
+  let read_skipping ~skip f =
+    let module Bulk = SyntaxFile(struct
+        include OPAMSyntax
+        let pp = skip_items skip -| pp
+      end)
+    in
+    Bulk.read_opt f
+
   (** Extra stuff for opam files *)
 
   let effective_part ?(modulo_state=false) (t:t) =
@@ -472,6 +472,14 @@ module OPAM: sig
 
   include IO_FILE with type t := t
 
+  (** Variant of [read_opt] for callers that only need some of the fields.
+      The top-level fields and sections named in [skip] are dropped before
+      being converted: they are left to their [empty] value, and their format
+      errors are not reported. [opam-version] must not be skipped. Errors are
+      otherwise handled as with [read_opt].
+      @raise OpamPp.Bad_format if the file can't be parsed *)
+  val read_skipping: skip:string list -> t typed_file -> t option
+
   val empty: t
 
   (** Create an opam file *)
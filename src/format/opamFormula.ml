@@ -320,26 +320,150 @@ let check (name,cstr) package =
   | None -> true
   | Some (relop, v) -> eval_relop relop (OpamPackage.version package) v
 
+(* Version constraints compiled to sorted, disjoint and non-empty intervals,
+   so that the matching versions can be extracted from a package set with a
+   few splits, rather than comparing each version to each atom *)
+module Intervals = struct
+
+  (* [true] for inclusive bounds *)
+  type lower = Lower_inf | Lower of bool * OpamPackage.Version.t
+  type upper = Upper_inf | Upper of bool * OpamPackage.Version.t
+
+  let full = [Lower_inf, Upper_inf]
+
+  let compare_lower l1 l2 = match l1, l2 with
+    | Lower_inf, Lower_inf -> 0
+    | Lower_inf, _ -> -1
+    | _, Lower_inf -> 1
+    | Lower (i1, v1), Lower (i2, v2) ->
+      match OpamPackage.Version.compare v1 v2 with
+      | 0 -> Bool.compare i2 i1
+      | c -> c
+
+  let compare_upper u1 u2 = match u1, u2 with
+    | Upper_inf, Upper_inf -> 0
+    | Upper_inf, _ -> 1
+    | _, Upper_inf -> -1
+    | Upper (i1, v1), Upper (i2, v2) ->
+      match OpamPackage.Version.compare v1 v2 with
+      | 0 -> Bool.compare i1 i2
+      | c -> c
+
+  (* Whether an interval ending at [u] and one starting at [l] overlap or
+     are contiguous *)
+  let meets u l = match u, l with
+    | Upper_inf, _ | _, Lower_inf -> true
+    | Upper (iu, vu), Lower (il, vl) ->
+      match OpamPackage.Version.compare vu vl with
+      | 0 -> iu || il
+      | c -> c > 0
+
+  let non_empty (l, u) = match l, u with
+    | Lower_inf, _ | _, Upper_inf -> true
+    | Lower (il, vl), Upper (iu, vu) ->
+      match OpamPackage.Version.compare vl vu with
+      | 0 -> il && iu
+      | c -> c < 0
+
+  let normalise t =
+    let rec aux acc = function
+      | (l1, u1) :: (l2, u2) :: r when meets u1 l2 ->
+        let u = if compare_upper u1 u2 >= 0 then u1 else u2 in
+        aux acc ((l1, u) :: r)
+      | i :: r -> aux (i :: acc) r
+      | [] -> List.rev acc
+    in
+    aux [] (List.sort (fun (l1, _) (l2, _) -> compare_lower l1 l2) t)
+
+  let union t1 t2 = normalise (t1 @ t2)
+
+  let inter t1 t2 =
+    normalise @@ List.fold_left (fun acc (l1, u1) ->
+        List.fold_left (fun acc (l2, u2) ->
+            let i =
+              (if compare_lower l1 l2 >= 0 then l1 else l2),
+              (if compare_upper u1 u2 <= 0 then u1 else u2)
+            in
+            if non_empty i then i :: acc else acc)
+          acc t2)
+      [] t1
+
+  let of_constraint (relop, v) = match relop with
+    | `Eq -> [Lower (true, v), Upper (true, v)]
+    | `Neq -> [Lower_inf, Upper (false, v); Lower (false, v), Upper_inf]
+    | `Geq -> [Lower (true, v), Upper_inf]
+    | `Gt -> [Lower (false, v), Upper_inf]
+    | `Leq -> [Lower_inf, Upper (true, v)]
+    | `Lt -> [Lower_inf, Upper (false, v)]
+
+  (* Follows [eval]: [Empty] is true *)
+  let rec of_formula atom = function
+    | Empty -> full
+    | Atom x -> atom x
+    | Block x -> of_formula atom x
+    | And (x, y) -> inter (of_formula atom x) (of_formula atom y)
+    | Or (x, y) -> union (of_formula atom x) (of_formula atom y)
+
+  let of_version_formula = of_formula of_constraint
+
+  (* The packages of [pkgs], all named [name], within the intervals *)
+  let filter name t pkgs =
+    let module S = OpamPackage.Set in
+    let split v pkgs =
+      let bound = OpamPackage.create name v in
+      let below, present, above = S.split bound pkgs in
+      let found () =
+        S.find_first (fun nv -> OpamPackage.compare nv bound >= 0) pkgs
+      in
+      below, (if present then Some found else None), above
+    in
+    List.fold_left (fun acc (l, u) ->
+        let pkgs = match l with
+          | Lower_inf -> pkgs
+          | Lower (incl, v) ->
+            match split v pkgs with
+            | _, Some found, above when incl -> S.add (found ()) above
+            | _, _, above -> above
+        in
+        let pkgs = match u with
+          | Upper_inf -> pkgs
+          | Upper (incl, v) ->
+            match split v pkgs with
+            | below, Some found, _ when incl -> S.add (found ()) below
+            | below, _, _ -> below
+        in
+        S.union acc pkgs)
+      S.empty t
+
+end
+
 let packages_of_atoms ?(disj=false) pkgset atoms =
   (* Conjunction for constraints over the same name (unless [disj] is
      specified), but disjunction on the package names *)
-  let ffilter = if disj then List.exists else List.for_all in
+  let combine = if disj then Intervals.union else Intervals.inter in
   let by_name =
-    List.fold_left (fun acc (n,_ as atom) ->
-        OpamPackage.Name.Map.update n (fun a -> atom::a) [] acc)
+    List.fold_left (fun acc (n, cstr) ->
+        let i = match cstr with
+          | None -> Intervals.full
+          | Some c -> Intervals.of_constraint c
+        in
+        OpamPackage.Name.Map.update n (fun l -> i::l) [] acc)
       OpamPackage.Name.Map.empty atoms
   in
-  OpamPackage.Name.Map.fold (fun name atoms acc ->
+  OpamPackage.Name.Map.fold (fun name intervals acc ->
+      let i = match intervals with
+        | i :: r -> List.fold_left combine i r
+        | [] -> Intervals.full
+      in
       OpamPackage.Set.union acc @@
-      OpamPackage.Set.filter
-        (fun nv -> ffilter (fun a -> check a nv) atoms)
-        (OpamPackage.packages_of_name pkgset name))
+      Intervals.filter name i (OpamPackage.packages_of_name pkgset name))
     by_name OpamPackage.Set.empty
 
 let satisfies_depends pkgset f =
   eval (fun (name, cstr) ->
-      OpamPackage.Set.exists (fun nv -> check_version_formula cstr nv.version)
-        (OpamPackage.packages_of_name pkgset name))
+      not (OpamPackage.Set.is_empty
+             (Intervals.filter name (Intervals.of_version_formula cstr)
+                (OpamPackage.packages_of_name pkgset name))))
     f
 
 let to_string t =
@@ -421,11 +545,13 @@ let packages pkgset f =
       let name_formula =
         map (fun ((n, _) as a) -> if n = name then Atom a else Empty) dnf
       in
+      let intervals =
+        Intervals.of_formula (fun (_name, cstr) ->
+            Intervals.of_version_formula cstr)
+          name_formula
+      in
       OpamPackage.Set.union acc @@
-      OpamPackage.Set.filter (fun nv ->
-          let v = OpamPackage.version nv in
-          eval (fun (_name, cstr) -> check_version_formula cstr v)
-            name_formula)
+      Intervals.filter name intervals
         (OpamPackage.packages_of_name pkgset name))
     names OpamPackage.Set.empty
 
@@ -220,44 +220,56 @@ let of_archive f =
   | None       -> None
   | Some (s,_) -> of_string_opt s
 
+(* $DIR/[$PREFIX/]$NAME.$VERSION/opam, or $DIR/[$PREFIX/]$NAME.$VERSION.opam.
+   Package directories are not descended into, so their [files/] are never
+   listed *)
+let scan dir =
+  log "scan %a" (slog OpamFilename.Dir.to_string) dir;
+  let prefix pkgdir =
+    match OpamFilename.remove_prefix_dir dir pkgdir with
+    | "" -> None
+    | p  -> Some p
+  in
+  let rec aux acc d =
+    let entries = OpamSystem.dir_entries (OpamFilename.Dir.to_string d) in
+    if List.mem ("opam", false) entries then
+      match of_dirname d with
+      | Some nv ->
+        (nv, prefix (OpamFilename.dirname_dir d), OpamFilename.Op.(d // "opam"))
+        :: acc
+      | None -> acc
+    else
+      List.fold_left (fun acc (name, is_dir) ->
+          if is_dir then aux acc OpamFilename.Op.(d / name) else
+          let f = OpamFilename.Op.(d // name) in
+          match of_filename f with
+          | Some nv -> (nv, prefix (OpamFilename.dirname_dir d), f) :: acc
+          | None -> acc)
+        acc entries
+  in
+  List.rev (aux [] dir)
+
 let list dir =
   log "list %a" (slog OpamFilename.Dir.to_string) dir;
-  if OpamFilename.exists_dir dir then (
-    let files = OpamFilename.rec_files dir in
-    List.fold_left (fun set f ->
-        match of_filename f with
-        | None   -> set
-        | Some p ->
-          if not (Set.mem p set) then Set.add p set
-          else
-            let suffix = Filename.concat (to_string p) "opam" in
-            let files = List.filter (OpamFilename.ends_with suffix) files in
-            OpamConsole.error_and_exit `File_error
-              "Multiple definition of package %s in %s:\n%s"
-              (to_string p) (OpamFilename.Dir.to_string dir)
-              (OpamStd.Format.itemize ~bullet:"" OpamFilename.to_string files);
-      ) Set.empty files
-  ) else
-    Set.empty
+  let defs = scan dir in
+  List.fold_left (fun set (nv, _, _) ->
+      if not (Set.mem nv set) then Set.add nv set
+      else
+        let files =
+          List.filter_map (fun (nv1, _, f) ->
+              if equal nv nv1 then Some f else None)
+            defs
+        in
+        OpamConsole.error_and_exit `File_error
+          "Multiple definition of package %s in %s:\n%s"
+          (to_string nv) (OpamFilename.Dir.to_string dir)
+          (OpamStd.Format.itemize ~bullet:"" OpamFilename.to_string files))
+    Set.empty defs
 
 let prefixes repodir =
   log "prefixes %a" (slog OpamFilename.Dir.to_string) repodir;
-  if OpamFilename.exists_dir repodir then (
-    let files = OpamFilename.rec_files repodir in
-    List.fold_left (fun map f ->
-        match of_filename f with
-        | None   -> map
-        | Some p ->
-          let pkgdir = OpamFilename.dirname_dir (OpamFilename.dirname f) in
-          let prefix =
-            match OpamFilename.remove_prefix_dir repodir pkgdir with
-            | "" -> None
-            | p  -> Some p
-          in
-          Map.add p prefix map
-      ) Map.empty files
-  ) else
-    Map.empty
+  List.fold_left (fun map (nv, prefix, _) -> Map.add nv prefix map)
+    Map.empty (scan repodir)
 
 let versions_of_packages nvset =
   Set.fold
@@ -128,6 +128,14 @@ val equal: t -> t -> bool
 (** Hash a package *)
 val hash: t -> int
 
+(** Lists, in one pass, the package definition files in a given directory
+    (either {i $name.$version/opam} or {i $name.$version.opam}), with their
+    package and the prefix of their package directory, as returned by
+    {!prefixes}. Directories containing an [opam] file are not descended
+    into. *)
+val scan:
+  OpamFilename.Dir.t -> (t * string option * OpamFilename.t) list
+
 (** Return all the package descriptions in a given directory *)
 val list: OpamFilename.Dir.t -> Set.t
 
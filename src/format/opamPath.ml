@@ -31,6 +31,11 @@ let state_cache_dir t = t / "repo"
 
 let state_cache t = state_cache_dir t // Printf.sprintf "state-%s.cache" (OpamVersion.magic ())
 
+let depexts_cache t = state_cache_dir t // "depexts.cache"
+
+let search_cache t =
+  state_cache_dir t // Printf.sprintf "search-%s.cache" (OpamVersion.magic ())
+
 let lock t = t // "lock"
 
 let config_lock t = t // "config.lock"
@@ -107,6 +112,8 @@ module Switch = struct
 
   let selections t a = meta t a /- "switch-state"
 
+  let selections_journal t a = meta t a // "switch-state.journal"
+
   let build_dir t a = meta t a / "build"
 
   let build t a nv = build_dir t a / OpamPackage.to_string nv
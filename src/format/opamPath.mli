@@ -24,6 +24,13 @@ val state_cache: t -> filename
 (** Directory containing state cache *)
 val state_cache_dir: t -> dirname
 
+(** Cache of the statuses of system packages *)
+val depexts_cache: t -> filename
+
+(** Cache of the search indexes of the repositories, saved along with
+    {!state_cache} *)
+val search_cache: t -> filename
+
 (** Global lock file for the whole opamroot. Opam should generally read-lock
     this (e.g. initialisation and format upgrades require a write lock) *)
 val lock: t -> filename
@@ -118,6 +125,10 @@ module Switch: sig
   (** Switch selections {i $meta/switch-state} *)
   val selections: t -> switch -> switch_selections OpamFile.t
 
+  (** Changes to the switch selections that are not yet written to
+      {!selections}, one per line: {i $meta/switch-state.journal} *)
+  val selections_journal: t -> switch -> filename
+
   (** Temporary folders used to decompress and compile
       the corresponding archives:
       {i $meta/build/$packages} *)
@@ -183,9 +183,14 @@ module VCS : OpamVCS.VCS = struct
         Done ()
       else Done ()
 
-  let patch_applied _ _ =
-    (* This might be a good place to do 'git reset --soft' and check for
-       unstaged changes. See <https://github.com/ocaml/opam/pull/3283>. *)
+  (* Records the commit that the working tree was last synchronised to, so
+     that the next [diff] can be computed between commits *)
+  let applied_ref = "refs/remotes/opam-applied"
+
+  let patch_applied repo_root repo_url =
+    git repo_root [ "update-ref"; applied_ref; remote_ref repo_url ]
+    @@> fun r ->
+    OpamSystem.raise_on_process_error r;
     Done ()
 
   let diff repo_root repo_url =
@@ -193,20 +198,46 @@ module VCS : OpamVCS.VCS = struct
     let patch_file = OpamSystem.temp_file ~auto_clean: false "git-diff" in
     let finalise () = OpamSystem.remove_file patch_file in
     OpamProcess.Job.catch (fun e -> finalise (); raise e) @@ fun () ->
-    git repo_root [ "add"; "." ] @@> fun r ->
-    (* Git diff is to the working dir, but doesn't work properly for
-       unregistered directories. *)
-    OpamSystem.raise_on_process_error r;
+    (git repo_root ~verbose:false
+       [ "rev-parse"; "--verify"; "--quiet"; applied_ref ]
+     @@> function
+     | { OpamProcess.r_code = 0; OpamProcess.r_stdout = [applied]; _ } as r ->
+       (* The working tree is at [applied]: diff the two trees directly,
+          without having git scan the working tree *)
+       OpamProcess.cleanup r;
+       Done (Some applied)
+     | r ->
+       OpamProcess.cleanup ~force:true r;
+       git repo_root [ "add"; "." ] @@> fun r ->
+       (* Git diff is to the working dir, but doesn't work properly for
+          unregistered directories. *)
+       OpamSystem.raise_on_process_error r;
+       Done None)
+    @@+ fun applied ->
+    let revs = match applied with
+      | Some applied -> [ applied; rref ]
+      | None -> [ "-R"; rref ]
+    in
     (* We also reset diff.noprefix here to handle already existing repo. *)
-    git repo_root ~stdout:patch_file [ "-c" ; "diff.noprefix=false" ; "diff" ; "--text" ; "--no-ext-diff" ; "-R" ; "-p" ; rref; "--" ]
+    git repo_root ~stdout:patch_file
+      ([ "-c" ; "diff.noprefix=false" ; "diff" ; "--text" ; "--no-ext-diff" ;
+         "-p" ] @ revs @ [ "--" ])
     @@> fun r ->
     if not (OpamProcess.check_success_and_cleanup r) then
       (finalise ();
        OpamSystem.internal_error "Git error: %s not found." rref)
-    else if OpamSystem.file_is_empty patch_file then
-      (finalise (); Done None)
     else
-      Done (Some (OpamFilename.of_string patch_file))
+      (* The ref is restored by [patch_applied]: until then, fall back to
+         comparing with the working tree, in case the patch fails to apply *)
+      (if applied = None then Done () else
+         git repo_root [ "update-ref"; "-d"; applied_ref ] @@> fun r ->
+         OpamSystem.raise_on_process_error r;
+         Done ())
+      @@+ fun () ->
+      if OpamSystem.file_is_empty patch_file then
+        (finalise (); Done None)
+      else
+        Done (Some (OpamFilename.of_string patch_file))
 
   let is_up_to_date ?subpath repo_root repo_url =
     let rref = remote_ref repo_url in
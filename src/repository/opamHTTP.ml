@@ -80,7 +80,9 @@ module B = struct
          in
          Done (Not_available (s,l)))
     @@ fun () ->
-    OpamDownload.download ~quiet:true ~overwrite:true ?checksum remote_url dirname
+    (* The checksums are all verified by the caller, in a single pass *)
+    OpamDownload.download ~quiet:true ~validate:false ~overwrite:true ?checksum
+      remote_url dirname
     @@+ fun local_file -> Done (Result (Some local_file))
 
   let revision _ =
@@ -55,6 +55,161 @@ let call_rsync check args =
     Done None
   | _ -> OpamSystem.process_error r
 
+(* Native synchronisation, used instead of rsync for local sources. Files are
+   compared using their size, modification time, inode and permissions, as
+   recorded in a manifest at the last synchronisation, rather than their
+   checksums. The manifest also records the modification time of the copies,
+   so that changes made on the destination side are caught too *)
+
+module SMap = OpamStd.String.Map
+module SSet = OpamStd.String.Set
+
+type stamp = {
+  size: int;
+  mtime: float;
+  inode: int;
+  perm: int;
+}
+
+type tree = {
+  files: stamp SMap.t; (* relative path, with '/' separators *)
+  dirs: SSet.t;
+}
+
+let vc_dirs = [".git"; "_darcs"; ".hg"]
+
+(* Same as the rsync [--exclude] list below: patterns match any path
+   component *)
+let sync_excluded ~exclude_vcdirs name =
+  exclude_vcdirs && List.mem name vc_dirs ||
+  OpamCompat.String.starts_with ~prefix:".#" name ||
+  OpamCompat.String.starts_with ~prefix:OpamSwitch.external_dirname name ||
+  name = "_build"
+
+(* Links are followed, as with rsync's [-L] *)
+let scan_tree ~excluded root =
+  let rec aux tree rel dir =
+    List.fold_left (fun tree (name, is_dir) ->
+        if excluded name then tree else
+        let rel = if rel = "" then name else rel ^ "/" ^ name in
+        let path = Filename.concat dir name in
+        if is_dir then aux { tree with dirs = SSet.add rel tree.dirs } rel path
+        else match Unix.stat path with
+          | { Unix.st_kind = Unix.S_REG;
+              st_size; st_mtime; st_ino; st_perm; _ } ->
+            let stamp =
+              { size = st_size; mtime = st_mtime; inode = st_ino;
+                perm = st_perm }
+            in
+            { tree with files = SMap.add rel stamp tree.files }
+          | _ -> tree
+          | exception Unix.Unix_error _ -> tree)
+      tree (OpamSystem.dir_entries dir)
+  in
+  aux { files = SMap.empty; dirs = SSet.empty } "" root
+
+let manifest_file dst =
+  let dst = Filename.concat (Filename.dirname dst) (Filename.basename dst) in
+  Filename.concat (Filename.dirname dst)
+    ("." ^ Filename.basename dst ^ ".opam-sync")
+
+let remove_manifest dir =
+  OpamSystem.remove_file (manifest_file (OpamFilename.Dir.to_string dir))
+
+(* Returns the recorded stamps of the source files, with the modification time
+   of their copies (or [0.] when the destination is not tracked), and the time
+   of the manifest. As in git, files modified less than 2 seconds (the coarsest
+   file system timestamp resolution) before that may have been changed again
+   without their stamp changing, and are not trusted *)
+let read_manifest dst =
+  let file = manifest_file dst in
+  match Unix.stat file with
+  | exception Unix.Unix_error _ -> None
+  | { Unix.st_mtime = since; _ } ->
+    try
+      let stamps =
+        List.fold_left (fun acc line ->
+            if line = "" then acc else
+            Scanf.sscanf line "%d %d %o %h %h %[^\n]"
+            @@ fun size inode perm mtime dst_mtime rel ->
+            SMap.add rel ({ size; mtime; inode; perm }, dst_mtime) acc)
+          SMap.empty (OpamStd.String.split (OpamSystem.read file) '\n')
+      in
+      Some (stamps, since -. 2.)
+    with Scanf.Scan_failure _ | Failure _ | End_of_file ->
+      log "Ignoring malformed manifest %s" file;
+      None
+
+let write_manifest dst files =
+  let b = Buffer.create 4096 in
+  SMap.iter (fun rel (st, dst_mtime) ->
+      Printf.bprintf b "%d %d %o %h %h %s\n"
+        st.size st.inode st.perm st.mtime dst_mtime rel)
+    files;
+  OpamSystem.write (manifest_file dst) (Buffer.contents b)
+
+(* Files whose stamp is too recent to be trusted are checked with [same] *)
+let changed_files ~old ~since ~same files =
+  let changed =
+    SMap.fold (fun rel st acc ->
+        match SMap.find_opt rel old with
+        | Some (st0, _) when st0 = st && (st.mtime < since || same rel) -> acc
+        | _ -> rel :: acc)
+      files []
+  in
+  SMap.fold (fun rel _ acc ->
+      if SMap.mem rel files then acc else rel :: acc)
+    old changed
+
+(* Synchronises [dst] with [src] like rsync with [--delete-excluded], and
+   returns the relative paths of the added, changed and removed files. Without
+   [manifest], everything is compared and no manifest is written *)
+let sync_dirs ?(manifest=true) ~exclude_vcdirs src dst =
+  let chrono = OpamConsole.timer () in
+  let src_tree = scan_tree ~excluded:(sync_excluded ~exclude_vcdirs) src in
+  let dst_tree = scan_tree ~excluded:(fun _ -> false) dst in
+  let old, since =
+    if not manifest then SMap.empty, 0. else
+      OpamStd.Option.default (SMap.empty, 0.) (read_manifest dst)
+  in
+  let removed =
+    SMap.fold (fun rel _ acc ->
+        if SMap.mem rel src_tree.files then acc
+        else (OpamSystem.remove_file (Filename.concat dst rel); rel :: acc))
+      dst_tree.files []
+  in
+  SSet.iter (fun rel ->
+      if not (SSet.mem rel src_tree.dirs) then
+        OpamSystem.remove_dir (Filename.concat dst rel))
+    dst_tree.dirs;
+  OpamSystem.mkdir dst;
+  SSet.iter (fun rel -> OpamSystem.mkdir (Filename.concat dst rel))
+    src_tree.dirs;
+  let changed, synced =
+    SMap.fold (fun rel st (changed, synced) ->
+        let src_file = Filename.concat src rel in
+        let dst_file = Filename.concat dst rel in
+        match SMap.find_opt rel old, SMap.find_opt rel dst_tree.files with
+        | Some (st0, dst_mtime), Some dst_st
+          when st0 = st && dst_st.size = st.size && dst_st.perm = st.perm &&
+               dst_st.mtime = dst_mtime &&
+               (st.mtime < since ||
+                Digest.file src_file = Digest.file dst_file) ->
+          changed, SMap.add rel (st, dst_mtime) synced
+        | _ ->
+          OpamSystem.clone_file src_file dst_file;
+          Unix.chmod dst_file st.perm;
+          Unix.utimes dst_file st.mtime st.mtime;
+          rel :: changed,
+          SMap.add rel (st, (Unix.stat dst_file).Unix.st_mtime) synced)
+      src_tree.files (removed, SMap.empty)
+  in
+  if manifest && (changed <> [] || not (SMap.equal (=) old synced)) then
+    write_manifest dst synced;
+  log "native sync %s -> %s: %d changed files, done in %.2fs."
+    src dst (List.length changed) (chrono ());
+  changed
+
 let rsync ?(args=[]) ?(exclude_vcdirs=true) src dst =
   log "rsync: src=%s dst=%s" src dst;
   let remote = String.contains src ':' in
@@ -84,6 +239,16 @@ let rsync ?(args=[]) ?(exclude_vcdirs=true) src dst =
   else if overlap src dst then
     (OpamConsole.error "Cannot sync %s into %s: they overlap" src dst;
      Done (Not_available (None, src)))
+  else if not remote && args = [] && Sys.is_directory src then
+    (* Without extra arguments, we know how to do it ourselves *)
+    (match sync_dirs ~exclude_vcdirs src dst with
+     | [] -> Done (Up_to_date [])
+     | changed -> Done (Result changed)
+     | exception (Unix.Unix_error _ | Sys_error _ | OpamSystem.Internal_error _
+                  as e) ->
+       OpamConsole.error "Cannot sync %s into %s: %s" src dst
+         (Printexc.to_string e);
+       Done (Not_available (None, src)))
   else (
     OpamSystem.mkdir dst;
     let convert_path = Lazy.force convert_path in
@@ -144,8 +309,50 @@ module B = struct
   let pull_dir_quiet local_dirname url =
     rsync_dirs url local_dirname
 
+  (* Source trees of the local repositories being updated, recorded as their
+     manifest once the update is complete *)
+  let pending_manifests = Hashtbl.create 7
+
   let fetch_repo_update repo_name ?cache_dir:_ repo_root url =
     log "pull-repo-update";
+    let root_s = OpamFilename.Dir.to_string repo_root in
+    let local_tree =
+      match OpamUrl.local_dir url with
+      | Some dir when not OpamRepositoryConfig.(!r.repo_tarring) ->
+        let tree =
+          scan_tree ~excluded:(sync_excluded ~exclude_vcdirs:true)
+            (OpamFilename.Dir.to_string dir)
+        in
+        (* The repository files are patched, not copied: their modification
+           time is not tracked *)
+        Hashtbl.replace pending_manifests root_s
+          (SMap.map (fun st -> st, 0.) tree.files);
+        Some (dir, tree)
+      | _ -> None
+    in
+    match local_tree, read_manifest root_s with
+    | Some (dir, tree), Some (old, since)
+      when OpamFilename.dir_is_empty repo_root = Some false ->
+      (* Only the files that changed since the last update need to be
+         compared. The manifest is only written back once the update is
+         applied, so that a failed update falls back to a full comparison. *)
+      OpamSystem.remove_file (manifest_file root_s);
+      let same rel =
+        let digest d = Digest.file (Filename.concat d rel) in
+        try digest (OpamFilename.Dir.to_string dir) = digest root_s
+        with Sys_error _ -> false
+      in
+      let changed = changed_files ~old ~since ~same tree.files in
+      log "%d files changed in %s" (List.length changed)
+        (OpamFilename.Dir.to_string dir);
+      (try
+         match OpamRepositoryBackend.get_files_diff repo_root dir changed with
+         | None -> Done OpamRepositoryBackend.Update_empty
+         | Some p -> Done (OpamRepositoryBackend.Update_patch p)
+       with e ->
+         OpamStd.Exn.fatal e;
+         Done (OpamRepositoryBackend.Update_err e))
+    | _ ->
     let quarantine =
       OpamFilename.Dir.(of_string (to_string repo_root ^ ".new"))
     in
@@ -157,7 +364,9 @@ module B = struct
     OpamRepositoryBackend.job_text repo_name "sync"
       (match OpamUrl.local_dir url with
        | Some dir ->
-         OpamFilename.copy_dir_except_vcs ~src:dir ~dst:quarantine;
+         ignore (sync_dirs ~manifest:false ~exclude_vcdirs:true
+                   (OpamFilename.Dir.to_string dir)
+                   (OpamFilename.Dir.to_string quarantine));
          (* fixme: Would be best to symlink, but at the moment our filename api
             isn't able to cope properly with the symlinks afterwards
             OpamFilename.link_dir ~target:dir ~link:quarantine; *)
@@ -186,7 +395,14 @@ module B = struct
         | None -> Done OpamRepositoryBackend.Update_empty
         | Some p -> Done (OpamRepositoryBackend.Update_patch p)
 
-  let repo_update_complete _ _ = Done ()
+  let repo_update_complete repo_root _ =
+    let root_s = OpamFilename.Dir.to_string repo_root in
+    (match Hashtbl.find_opt pending_manifests root_s with
+     | Some files ->
+       Hashtbl.remove pending_manifests root_s;
+       write_manifest root_s files
+     | None -> ());
+    Done ()
 
   let pull_url ?full_fetch:_ ?cache_dir:_ ?subpath local_dirname _checksum remote_url =
     let local_dirname = OpamFilename.SubPath.(local_dirname /? subpath) in
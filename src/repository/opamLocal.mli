@@ -21,3 +21,8 @@ val rsync_dirs: ?args:string list -> ?exclude_vcdirs:bool ->
 val rsync_file: ?args:string list ->
   OpamUrl.t -> OpamFilename.t ->
   unit download OpamProcess.job
+
+(** Removes the manifest kept by the native synchronisation of local sources
+    into the given directory, if any. To be called when that directory is
+    removed for good, e.g. on unpin. *)
+val remove_manifest: OpamFilename.Dir.t -> unit
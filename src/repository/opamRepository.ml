@@ -49,21 +49,50 @@ let link_files ~target f l =
       OpamFilename.link ~relative:true ~target ~link:(f x))
     l
 
-let fetch_from_cache =
+(* Ensures that a given archive is retrieved only once at a time, both within
+   this process and across the opam processes sharing [cache_dir]: the first
+   one to get the lock file of the archive fetches it, the others wait and then
+   find it in the cache. Cache hits don't take the lock. *)
+let with_download_lock =
   let currently_downloading = ref [] in
-  let rec no_concurrent_dls key f x =
-    if OpamStd.List.mem OpamHash.equal key !currently_downloading then
-      Run (OpamProcess.command "sleep" ["1"],
-           (fun _ -> no_concurrent_dls key f x))
-    else
-      (currently_downloading := key :: !currently_downloading;
-       OpamProcess.Job.finally
-         (fun () ->
+  fun cache_dir checksums job ->
+  match cache_dir, OpamHash.sort checksums with
+  | None, _ | _, [] -> job ()
+  | Some cache_dir, key :: _ ->
+    let in_cache () =
+      List.exists (fun ck -> OpamFilename.exists (cache_file cache_dir ck))
+        checksums
+    in
+    let lock_file = OpamFilename.add_extension (cache_file cache_dir key) "lock" in
+    let wait f =
+      Run (OpamProcess.command "sleep" ["1"], fun _ -> f ())
+    in
+    let rec aux () =
+      if in_cache () then job () else
+      if OpamStd.List.mem OpamHash.equal key !currently_downloading then
+        wait aux
+      else
+      match
+        if OpamCoreConfig.(!r.safe_mode) then Some OpamSystem.lock_none
+        else OpamFilename.try_flock `Lock_write lock_file
+      with
+      | None ->
+        log "%s is being downloaded by another process, waiting"
+          (OpamHash.to_string key);
+        wait aux
+      | Some lock ->
+        currently_downloading := key :: !currently_downloading;
+        OpamProcess.Job.finally (fun () ->
             currently_downloading :=
-              List.filter (fun k -> k <> key) !currently_downloading)
-         (fun () -> f x))
-  in
-  fun cache_dir cache_urls checksums ->
+              List.filter (fun k -> not (OpamHash.equal k key))
+                !currently_downloading;
+            OpamSystem.funlock lock;
+            OpamFilename.remove lock_file)
+          job
+    in
+    aux ()
+
+let fetch_from_cache cache_dir cache_urls checksums =
   let mismatch file =
     OpamConsole.error
       "Conflicting file hashes, or broken or compromised cache!\n%s"
@@ -108,9 +137,8 @@ let fetch_from_cache =
     with
     | None, _ -> raise Not_found
     | Some hit_file, miss_files ->
-      if List.for_all
-          (fun ck -> OpamHash.check_file (OpamFilename.to_string hit_file) ck)
-          checksums
+      if OpamHash.mismatch_all (OpamFilename.to_string hit_file) checksums
+         = None
       then begin
         link_files ~target:hit_file Fun.id miss_files;
         Done (Up_to_date (hit_file, OpamUrl.empty))
@@ -132,25 +160,23 @@ let fetch_from_cache =
           @@ fun () ->
           dl_from_cache_job root_cache_url checksum tmpfile
           @@+ fun () ->
-          if List.for_all (OpamHash.check_file (OpamFilename.to_string tmpfile))
-              checksums
+          if OpamHash.mismatch_all (OpamFilename.to_string tmpfile) checksums
+             = None
           then
             (OpamFilename.move ~src:tmpfile ~dst:local_file;
              link_files ~target:local_file (cache_file cache_dir) other_checksums;
              Done (Result (local_file, root_cache_url)))
           else mismatch tmpfile
       in
-      no_concurrent_dls checksum try_cache_dl cache_urls
+      try_cache_dl cache_urls
 
 let validate_and_add_to_cache label url cache_dir file checksums =
-  try
-    let mismatch, expected =
-      OpamStd.List.find_map (fun c ->
-          match OpamHash.mismatch (OpamFilename.to_string file) c with
-          | Some found -> Some (found, c)
-          | None -> None)
-        checksums
-    in
+  (* Hashing is pure, let it run alongside the other jobs. All the checksums
+     are computed in a single read of the file. *)
+  OpamProcess.Job.compute (fun () ->
+      OpamHash.mismatch_all (OpamFilename.to_string file) checksums)
+  @@| function
+  | Some (mismatch, expected) ->
     OpamConsole.error "%s: Checksum mismatch for %s:\n\
                       \  expected %s\n\
                       \  got      %s"
@@ -159,7 +185,7 @@ let validate_and_add_to_cache label url cache_dir file checksums =
       (OpamHash.to_string mismatch);
     OpamFilename.remove file;
     false
-  with Not_found ->
+  | None ->
     (let checksums = OpamHash.sort checksums in
      match cache_dir, checksums with
      | Some dir, best_chks :: others_chks ->
@@ -216,16 +242,18 @@ let pull_from_upstream
    in
    pull ?full_fetch ?cache_dir ?subpath destdir cksum url
   )
-  @@| function
+  @@+ function
   | (Result (Some file) | Up_to_date (Some file)) as ret ->
-    if OpamRepositoryConfig.(!r.force_checksums) = Some false
-    || validate_and_add_to_cache label url cache_dir file checksums
-    then ret
+    if OpamRepositoryConfig.(!r.force_checksums) = Some false then Done ret
     else
-    let m = "Checksum mismatch" in
-    Not_available (Some m, m)
-  | (Result None | Up_to_date None) as ret -> ret
-  | Not_available _ as na -> na
+      validate_and_add_to_cache label url cache_dir file checksums
+      @@| fun valid ->
+      if valid then ret
+      else
+      let m = "Checksum mismatch" in
+      Not_available (Some m, m)
+  | (Result None | Up_to_date None) as ret -> Done ret
+  | Not_available _ as na -> Done na
 
 let pull_from_mirrors label ?full_fetch ?working_dir ?subpath
     cache_dir destdir checksums urls =
@@ -328,6 +356,7 @@ let pull_tree_t
             Done (Not_available (Some simple, long)))
   in
   let label = OpamStd.List.concat_map ", " (fun (x,_,_) -> x) dirnames in
+  with_download_lock cache_dir checksums @@ fun () ->
   (match cache_dir with
    | Some cache_dir ->
      let text = OpamProcess.make_command_text label "dl" in
@@ -408,6 +437,7 @@ let revision dirname url =
 
 let pull_file label ?cache_dir ?(cache_urls=[])  ?(silent_hits=false)
     file checksums remote_urls =
+  with_download_lock cache_dir checksums @@ fun () ->
   (match cache_dir with
    | Some cache_dir ->
      let text = OpamProcess.make_command_text label "dl" in
@@ -448,6 +478,7 @@ let pull_file label ?cache_dir ?(cache_urls=[])  ?(silent_hits=false)
 
 let pull_file_to_cache label ~cache_dir ?(cache_urls=[]) checksums remote_urls =
   let text = OpamProcess.make_command_text label "dl" in
+  with_download_lock (Some cache_dir) checksums @@ fun () ->
   OpamProcess.Job.with_text text @@
   fetch_from_cache cache_dir cache_urls checksums @@+ function
   | Up_to_date (_, _) ->
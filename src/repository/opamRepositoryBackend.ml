@@ -126,6 +126,18 @@ let strip_repo_suffix patch =
   in
   {patch with operation}
 
+let patch_of_diffs chrono = function
+  | [] ->
+    log "Internal diff (empty) done in %.2fs." (chrono ());
+    None
+  | diffs ->
+    log "Internal diff (non-empty, %a changed files) done in %.2fs."
+      (slog (fun l -> string_of_int (List.length l))) diffs (chrono ());
+    let patch = OpamSystem.temp_file ~auto_clean:false "patch" in
+    let patch_file = OpamFilename.of_string patch in
+    OpamFilename.write patch_file (Format.asprintf "%a" Patch.pp_list diffs);
+    Some (patch_file, List.map strip_repo_suffix diffs)
+
 let get_diff parent_dir dir1 dir2 =
   let chrono = OpamConsole.timer () in
   log "diff: %a/{%a,%a}"
@@ -182,18 +194,33 @@ let get_diff parent_dir dir1 dir2 =
     in
     diffs
   in
-  match
-    aux []
-      (Some (OpamFilename.Base.to_string dir1))
-      (Some (OpamFilename.Base.to_string dir2))
-  with
-  | [] ->
-    log "Internal diff (empty) done in %.2fs." (chrono ());
-    None
-  | diffs ->
-    log "Internal diff (non-empty, %a changed files) done in %.2fs."
-      (slog (fun l -> string_of_int (List.length l))) diffs (chrono ());
-    let patch = OpamSystem.temp_file ~auto_clean:false "patch" in
-    let patch_file = OpamFilename.of_string patch in
-    OpamFilename.write patch_file (Format.asprintf "%a" Patch.pp_list diffs);
-    Some (patch_file, List.map strip_repo_suffix diffs)
+  patch_of_diffs chrono
+    (aux []
+       (Some (OpamFilename.Base.to_string dir1))
+       (Some (OpamFilename.Base.to_string dir2)))
+
+let get_files_diff dir1 dir2 files =
+  let chrono = OpamConsole.timer () in
+  log "diff: {%a,%a}"
+    (slog OpamFilename.Dir.to_string) dir1
+    (slog OpamFilename.Dir.to_string) dir2;
+  let read dir file =
+    let prefix = OpamFilename.(Base.to_string (basename_dir dir)) in
+    let real_file = Filename.concat (OpamFilename.Dir.to_string dir) file in
+    match Unix.stat real_file with
+    | {Unix.st_kind = Unix.S_REG; _} ->
+      Some (prefix ^ "/" ^ file, OpamSystem.read real_file)
+    | {Unix.st_kind = Unix.S_DIR; _} ->
+      failwith "Change between a directory and a regular file is unsupported"
+    | _ -> failwith "Only regular files are supported"
+    | exception Unix.Unix_error (Unix.ENOENT, _, _) -> None
+  in
+  patch_of_diffs chrono
+    (List.fold_left (fun diffs file ->
+         match read dir1 file, read dir2 file with
+         | None, None -> diffs
+         | content1, content2 ->
+           match Patch.diff content1 content2 with
+           | None -> diffs
+           | Some diff -> diff :: diffs)
+        [] files)
@@ -118,3 +118,13 @@ val job_text:
     named pipes, sockets.
     Unsupported comparison: comparison between regular files and directories. *)
 val get_diff: dirname -> basename -> basename -> (filename * Patch.t list) option
+
+(** [get_files_diff dir1 dir2 files] is like {!get_diff}, but only compares the
+    given files, given relative to both directories, e.g. when the changed files
+    are already known. Files that don't exist on one side are created or
+    deleted.
+
+    @raise Stdlib.Failure if one of the files is not a regular file on either
+    side. *)
+val get_files_diff:
+  dirname -> dirname -> string list -> (filename * Patch.t list) option
@@ -449,8 +449,17 @@ let action_contents = function
 exception Solver_failure of string
 exception Cyclic_actions of Action.t list list
 
+type explanation =
+  [ `Conflict of string option * string list * bool
+  | `Missing of string option * string * OpamFormula.t
+  | `Truncated
+  ]
+
 type conflict_case =
-  | Conflict_dep of (unit -> Dose_algo.Diagnostic.reason list)
+  | Conflict_dep of (unit -> Dose_algo.Diagnostic.reason list) *
+                    (package_set * explanation list) option ref
+  (** The reasons of the conflict, and the explanations already computed from
+      them, for the given set of packages *)
   | Conflict_cycle of Cudf.package action list list
 type conflict =
   Cudf.universe * int package_map * conflict_case
@@ -661,10 +670,10 @@ let vpkg2atom cudfnv2opam (name,cstr) =
 *)
 
 let conflict_empty ~version_map univ =
-  Conflicts (univ, version_map, Conflict_dep (fun () -> []))
+  Conflicts (univ, version_map, Conflict_dep ((fun () -> []), ref None))
 let make_conflicts ~version_map univ = function
   | {Dose_algo.Diagnostic.result = Dose_algo.Diagnostic.Failure f; _} ->
-    Conflicts (univ, version_map, Conflict_dep f)
+    Conflicts (univ, version_map, Conflict_dep (f, ref None))
   | {Dose_algo.Diagnostic.result = Dose_algo.Diagnostic.Success _; _} ->
     raise (Invalid_argument "make_conflicts")
 let cycle_conflict ~version_map univ cycle =
@@ -735,11 +744,6 @@ module ChainSet = struct
   let length cs = fold (fun l acc -> min (List.length l) acc) cs max_int
 end
 
-type explanation =
-  [ `Conflict of string option * string list * bool
-  | `Missing of string option * string * OpamFormula.t
-  ]
-
 module Pp_explanation = struct
   let pp_package fmt pkg =
     let name = pkg.Cudf.package in
@@ -813,14 +817,25 @@ module Pp_explanation = struct
       Format.fprintf fmt "`Conflict (%a, %a, %b)" (pp_option Format.pp_print_string) x (pp_inline_list Format.pp_print_string) y b
     | `Missing (x, y, formula) ->
       Format.fprintf fmt "`Missing (%a, %s, %a)" (pp_option Format.pp_print_string) x y pp_formula formula
+    | `Truncated -> Format.pp_print_string fmt "`Truncated"
 
   let pp_explanationlist fmt l = pp_list pp_explanation fmt l
 end
 
+(* Explaining the conflicts of a large universe can take a long time: past this
+   amount of CPU time (in seconds) or number of explanations, the explanations
+   found so far are returned, followed by [`Truncated]. The time budget also
+   covers the computation of the dependency chains, and at most
+   [explanations_max] chains are kept per package. *)
+let explanations_time_budget = 5.
+let explanations_max = 500
+
 let extract_explanations packages cudfnv2opam reasons : explanation list =
   log "Conflict reporting";
   let open Dose_algo.Diagnostic in
   let module CS = ChainSet in
+  let deadline = Sys.time () +. explanations_time_budget in
+  let truncated = ref false in
   (* Definitions and printers *)
   log ~level:3 "Reasons: %a" (Pp_explanation.pp_reasonlist cudfnv2opam) reasons;
   let all_opam =
@@ -836,6 +851,22 @@ let extract_explanations packages cudfnv2opam reasons : explanation list =
       OpamPackage.Set.empty
       reasons
   in
+  let all_opam_versions = OpamPackage.to_map all_opam in
+  let formula_of_vpkgl =
+    let memo = Hashtbl.create 53 in
+    fun vpkgl ->
+      try Hashtbl.find memo vpkgl with Not_found ->
+        let f = formula_of_vpkgl cudfnv2opam packages vpkgl in
+        Hashtbl.add memo vpkgl f;
+        f
+  in
+  (* Index of the dependencies of each package, with the position of the
+     reasons they come from *)
+  let dep_vpkgs = Hashtbl.create 53 in
+  List.iteri (fun i -> function
+      | Dependency (p, vpl, _) -> Hashtbl.add dep_vpkgs p (i, vpl)
+      | Conflict _ | Missing _ -> ())
+    reasons;
   let open (struct
     type bold = bool
     type construct =
@@ -855,7 +886,10 @@ let extract_explanations packages cudfnv2opam reasons : explanation list =
     in
     let strs =
       OpamPackage.Name.Map.mapi (fun name versions ->
-          let all_versions = OpamPackage.versions_of_name all_opam name in
+          let all_versions =
+            OpamPackage.Name.Map.find_opt name all_opam_versions
+            |> OpamStd.Option.default OpamPackage.Version.Set.empty
+          in
           let formula =
             OpamFormula.formula_of_version_set all_versions versions
           in
@@ -869,11 +903,12 @@ let extract_explanations packages cudfnv2opam reasons : explanation list =
       | [] -> []
       | pkgs :: r ->
         let vpkgl1 =
-          List.fold_left (fun acc -> function
-              | Dependency (p1, vpl, _) when Set.mem p1 pkgs ->
-                List.rev_append vpl acc
-              | _ -> acc)
-            [] reasons
+          (* the dependencies of [pkgs], in the order of [reasons] *)
+          Set.fold (fun p acc ->
+              List.rev_append (Hashtbl.find_all dep_vpkgs p) acc)
+            pkgs []
+          |> List.sort (fun (i, _) (j, _) -> compare i j)
+          |> List.fold_left (fun acc (_, vpl) -> List.rev_append vpl acc) []
         in
         if Set.exists is_artefact pkgs then
           if Set.exists is_opam_invariant pkgs then
@@ -891,7 +926,7 @@ let extract_explanations packages cudfnv2opam reasons : explanation list =
           in
           (* TODO: We should aim to use what does give us not guess the formula *)
           (* Dose is precise enough from what i'm seeing *)
-          formula_of_vpkgl cudfnv2opam packages vpkgl
+          formula_of_vpkgl vpkgl
         in
         Formula (hl_last && r = [], f) :: aux vpkgl1 r
     in
@@ -929,14 +964,29 @@ let extract_explanations packages cudfnv2opam reasons : explanation list =
   in
   let _seen, ct_chains =
     (* get a covering tree from the roots to all reachable packages. *)
+    (* Only the smallest chain of each package is used in the end, and it is
+       made of the smallest chains of its parents: keeping the smallest
+       [explanations_max] ones doesn't change it *)
+    let cap cs =
+      if CS.cardinal cs <= explanations_max then cs else
+        fst (CS.fold (fun c (acc, n) ->
+            if n < explanations_max then CS.add c acc, n + 1 else acc, n)
+            cs (CS.empty, 0))
+    in
     let rec aux seen ct_chains =
       Map.fold (fun pkg parent_chain (seen, ct_chains) ->
           if Set.mem pkg seen then (seen, ct_chains) else
+          if Sys.time () > deadline then
+            (truncated := true; (seen, ct_chains))
+          else
           let dependencies = get deps pkg in
           let seen = Set.add pkg seen in
           Set.fold (fun dep (seen, ct_chains) ->
               let chain = CS.map (fun c -> dep :: c) parent_chain in
-              let ct_chains = Map.update dep (CS.union chain) CS.empty ct_chains in
+              let ct_chains =
+                Map.update dep (fun cs -> cap (CS.union chain cs)) CS.empty
+                  ct_chains
+              in
               aux seen ct_chains
             ) dependencies (seen, ct_chains)
         ) ct_chains
@@ -1003,50 +1053,73 @@ let extract_explanations packages cudfnv2opam reasons : explanation list =
     arrow_concat (List.map aux cst)
   in
 
-  let explanations =
-    List.fold_left (fun explanations re ->
-        let cst ?hl_last ct_chains p =
-          let chains = Map.find p ct_chains in
-          cs_to_string ?hl_last chains
+  let cst =
+    let memo = Hashtbl.create 53 in
+    fun ?(hl_last=true) p ->
+      try Hashtbl.find memo (hl_last, p) with Not_found ->
+        let chains =
+          (* the covering tree may not have reached [p] in time *)
+          try Map.find p ct_chains
+          with Not_found when !truncated -> CS.singleton [p]
         in
-        try
-          match re with
-          | Conflict (l, r, _) ->
-            let csl = cst ct_chains l in
-            let csr = cst ct_chains r in
-            let msg1 =
-              if l.Cudf.package = r.Cudf.package then
-                Some (Package.name_to_string l)
-              else
-                None
-            in
-            let msg2 = List.sort_uniq compare [csl; csr] in
-            let msg3 = has_invariant l || has_invariant r in
-            let msg = `Conflict (msg1, msg2, msg3) in
-            msg :: explanations
-          | Missing (p, deps) ->
-            let csp = cst ~hl_last:false ct_chains p in
+        let cs = cs_to_string ~hl_last chains in
+        Hashtbl.add memo (hl_last, p) cs;
+        cs
+  in
+
+  let explain re =
+    try
+      match re with
+      | Conflict (l, r, _) ->
+        let csl = cst l in
+        let csr = cst r in
+        let msg1 =
+          if l.Cudf.package = r.Cudf.package then
+            Some (Package.name_to_string l)
+          else
+            None
+        in
+        let msg2 = List.sort_uniq compare [csl; csr] in
+        let msg3 = has_invariant l || has_invariant r in
+        let msg = `Conflict (msg1, msg2, msg3) in
+        Some msg
+      | Missing (p, deps) ->
+        let csp = cst ~hl_last:false p in
+        let msg =
+          if List.exists
+              (fun (name, _) -> name = unavailable_package_name)
+              deps
+          then
             let msg =
-              if List.exists
-                  (fun (name, _) -> name = unavailable_package_name)
-                  deps
-              then
-                let msg =
-                  Printf.sprintf "%s: no longer available"
-                    (OpamPackage.to_string (cudf2opam p))
-                in
-                let csp = construct_to_string csp in
-                `NoLongerAvailable (csp, msg, OpamFormula.Empty)
-              else
-              let fdeps = formula_of_vpkgl cudfnv2opam packages deps in
-              `Missing (csp, fdeps)
+              Printf.sprintf "%s: no longer available"
+                (OpamPackage.to_string (cudf2opam p))
             in
-            msg :: explanations
-          | Dependency _ ->
-            explanations
-        with Not_found ->
-          explanations)
-      [] reasons
+            let csp = construct_to_string csp in
+            `NoLongerAvailable (csp, msg, OpamFormula.Empty)
+          else
+          let fdeps = formula_of_vpkgl deps in
+          `Missing (csp, fdeps)
+        in
+        Some msg
+      | Dependency _ ->
+        None
+    with Not_found ->
+      None
+  in
+
+  let explanations =
+    let rec aux explanations n = function
+      | [] -> explanations
+      | _ when n > 0 && (n >= explanations_max || Sys.time () > deadline) ->
+        log "Conflict explanation budget exceeded, keeping the first %d" n;
+        truncated := true;
+        explanations
+      | re :: reasons ->
+        match explain re with
+        | Some msg -> aux (msg :: explanations) (n + 1) reasons
+        | None -> aux explanations n reasons
+    in
+    aux [] 0 reasons
   in
 
   let rec simplify_formula formula1 formula2 =
@@ -1163,7 +1236,9 @@ let extract_explanations packages cudfnv2opam reasons : explanation list =
       "Internal error while computing conflict explanations:\n\
        sorry about that. Please report how you got here in \
        https://github.com/ocaml/opam/discussions/5130 if possible."
-  | _ -> explanations
+  | _ ->
+    (* the list is in reverse order: the note comes last *)
+    if !truncated then `Truncated :: explanations else explanations
 
 let strings_of_cycles cycles =
   let string_of_cycle cycle =
@@ -1179,11 +1254,22 @@ let string_of_conflict ?(start_column=0) (msg1, msg2, msg3) =
   OpamStd.List.concat_map ~left:"\n" ~nil:"" "\n"
     (fun s -> OpamStd.Format.reformat ~indent:2 ~width s) msg3
 
-let conflict_explanations_raw packages = function
-  | univ, version_map, Conflict_dep reasons ->
-    let r = reasons () in
+(* Explanations are only computed once per conflict, since they are often
+   needed both for printing and for inspection *)
+let cached_explanations packages univ version_map reasons cache =
+  match !cache with
+  | Some (pkgs, explanations) when pkgs == packages -> explanations
+  | _ ->
     let cudfnv2opam = cudfnv2opam ~cudf_universe:univ ~version_map in
-    List.rev (extract_explanations packages cudfnv2opam r),
+    let explanations =
+      extract_explanations packages cudfnv2opam (reasons ())
+    in
+    cache := Some (packages, explanations);
+    explanations
+
+let conflict_explanations_raw packages = function
+  | univ, version_map, Conflict_dep (reasons, cache) ->
+    List.rev (cached_explanations packages univ version_map reasons cache),
     []
   | _univ, _version_map, Conflict_cycle cycles ->
     [], cycles
@@ -1213,12 +1299,15 @@ let string_of_explanation unav_reasons = function
     and msg3 = OpamFormula.fold_right (fun a x -> unav_reasons x::a) [] fdeps
     in
     (msg1, [msg2], msg3)
+  | `Truncated ->
+    ("(explanation truncated: this conflict is too large to be explained in \
+      full)", [], [])
 
 let conflict_explanations packages unav_reasons = function
-  | univ, version_map, Conflict_dep reasons ->
-    let r = reasons () in
-    let cudfnv2opam = cudfnv2opam ~cudf_universe:univ ~version_map in
-    let explanations = extract_explanations packages cudfnv2opam r in
+  | univ, version_map, Conflict_dep (reasons, cache) ->
+    let explanations =
+      cached_explanations packages univ version_map reasons cache
+    in
     List.rev_map (string_of_explanation unav_reasons) explanations, []
   | _univ, _version_map, Conflict_cycle cycles ->
     [], strings_of_cycles cycles
@@ -1443,6 +1532,7 @@ let compute_conflicts univ packages =
     Set.empty
 
 let preprocess_cudf_request (props, univ, creq) criteria =
+  OpamTrace.span ~cat:"solver" "cudf preprocess" @@ fun () ->
   let chrono = OpamConsole.timer () in
   let univ0 = univ in
   let do_trimming =
@@ -1575,6 +1665,7 @@ let call_external_solver ~version_map univ req =
         else preprocess_cudf_request cudf_request criteria
       in
       let r =
+        OpamTrace.span ~cat:"solver" "solver call" @@ fun () ->
         check_request_using
           ~call_solver:(OpamSolverConfig.call_solver ~criteria)
           ~explain:true cudf_request
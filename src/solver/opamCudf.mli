@@ -216,9 +216,12 @@ val cycle_conflict:
   version_map:int package_map -> Cudf.universe ->
   Cudf.package action list list -> ('a, conflict) result
 
+(** [`Truncated] comes last when the conflict was too large to be explained in
+    full, in the allotted time or number of explanations *)
 type explanation =
   [ `Conflict of string option * string list * bool
   | `Missing of string option * string * OpamFormula.t
+  | `Truncated
   ]
 
 (** Convert a conflict to something readable by the user. The second argument
@@ -281,6 +284,12 @@ val packages: Cudf.universe -> Cudf.package list
 val to_cudf: Cudf.universe -> Cudf_types.vpkg request
   -> Cudf.preamble * Cudf.universe * Cudf.request
 
+(** Trims the universe of a Cudf request from the packages that can't take
+    part in its solution, given the optimisation [criteria] *)
+val preprocess_cudf_request:
+  Cudf.preamble * Cudf.universe * Cudf.request -> string ->
+  Cudf.preamble * Cudf.universe * Cudf.request
+
 (** Like {!OpamTypesBase.action_contents} but return the single package of
     remove, install, reinstal, and change action *)
 val action_contents: 'a action -> 'a
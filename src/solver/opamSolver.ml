@@ -439,19 +439,81 @@ let map_request f r =
 let cycle_conflict ~version_map univ cycles =
   OpamCudf.cycle_conflict ~version_map univ cycles
 
-let resolve universe request =
-  log "resolve request=%a" (slog string_of_request) request;
+let resolver universe =
   let all_packages = Lazy.force universe.u_available ++ universe.u_installed in
   let version_map = cudf_versions_map universe in
-  let univ_gen = load_cudf_universe universe ~version_map all_packages in
-  let cudf_universe = univ_gen ~depopts:false ~build:true ~post:true () in
+  let load_f = load_cudf_packages universe ~version_map all_packages in
+  (* The translation of the universe doesn't depend on the request: it is
+     computed once, and a fresh CUDF universe is loaded from it for each request
+     since the solver call modifies it *)
+  let packages_map = lazy (load_f ~depopts:false ~build:true ~post:true ()) in
+  let simple_universe =
+    lazy (map_to_cudf_universe
+            (load_f ~depopts:true ~build:false ~post:false ()))
+  in
+  let complete_universe =
+    lazy (map_to_cudf_universe
+            (load_f ~depopts:true ~build:true ~post:false ()))
+  in
+  let invariant_pkg =
+    opam_invariant_package version_map universe.u_invariant
+  in
+  let attributes = List.map fst universe.u_attrs in
+  (* Overrides the attributes that depend on the packages requested when
+     building [universe]: the query marks, and the reinstalls, that are limited
+     to the dependency cone of the requested packages *)
+  let with_requested requested packages_map =
+    let query = "opam-query" in
+    let universe_query =
+      match OpamStd.List.assoc_opt String.equal query universe.u_attrs with
+      | Some set -> Lazy.force set
+      | None -> OpamPackage.Set.empty
+    in
+    let reinstall =
+      if OpamPackage.Set.is_empty universe.u_reinstall then
+        OpamPackage.Set.empty
+      else
+      let complete_universe = Lazy.force complete_universe in
+      Dose_algo.Depsolver.dependency_closure complete_universe
+        (Cudf.get_packages complete_universe ~filter:(fun cp ->
+             OpamPackage.Set.mem (OpamCudf.cudf2opam cp) requested))
+      |> List.fold_left (fun acc cp ->
+          OpamPackage.Set.add (OpamCudf.cudf2opam cp) acc)
+        OpamPackage.Set.empty
+      |> OpamPackage.Set.inter universe.u_reinstall
+    in
+    let set_extra label value set nv cp =
+      let extra = List.remove_assoc label cp.Cudf.pkg_extra in
+      { cp with Cudf.pkg_extra =
+                  if OpamPackage.Set.mem nv set then (label, value) :: extra
+                  else extra }
+    in
+    OpamPackage.Set.fold (fun nv map ->
+        match OpamPackage.Map.find_opt nv map with
+        | None -> map
+        | Some cp ->
+          OpamPackage.Map.add nv
+            (cp
+             |> set_extra query (`Int 1) requested nv
+             |> set_extra OpamCudf.s_reinstall (`Bool true) reinstall nv)
+            map)
+      (universe_query ++ requested ++ universe.u_reinstall)
+      packages_map
+  in
+  fun ?requested request ->
+  log "resolve request=%a" (slog string_of_request) request;
+  let packages_map =
+    match requested with
+    | None -> Lazy.force packages_map
+    | Some requested -> with_requested requested (Lazy.force packages_map)
+  in
+  let cudf_universe = map_to_cudf_universe packages_map in
   let requested_names =
     OpamPackage.Name.Set.of_list (List.map fst request.wish_all)
   in
   let request =
     let extra_attributes =
-      OpamStd.List.sort_nodup compare
-        (List.map fst universe.u_attrs @ request.extra_attributes)
+      OpamStd.List.sort_nodup compare (attributes @ request.extra_attributes)
     in
     { request with extra_attributes }
   in
@@ -464,9 +526,6 @@ let resolve universe request =
     opam_deprequest_package version_map (OpamFormula.ands deprequest)
   in
   let cudf_request = map_request (atom2cudf universe version_map) request in
-  let invariant_pkg =
-    opam_invariant_package version_map universe.u_invariant
-  in
   let solution =
     try
       Cudf.add_package cudf_universe invariant_pkg;
@@ -487,8 +546,8 @@ let resolve universe request =
   match solution with
   | Conflicts _ as c -> c
   | Success actions ->
-    let simple_universe = univ_gen ~depopts:true ~build:false ~post:false () in
-    let complete_universe = univ_gen ~depopts:true ~build:true ~post:false () in
+    let simple_universe = Lazy.force simple_universe in
+    let complete_universe = Lazy.force complete_universe in
     try
       let atomic_actions =
         OpamCudf.atomic_actions
@@ -498,6 +557,8 @@ let resolve universe request =
     with OpamCudf.Cyclic_actions cycles ->
       cycle_conflict ~version_map complete_universe cycles
 
+let resolve universe request = resolver universe request
+
 let get_atomic_action_graph t =
   cudf_to_opam_graph OpamCudf.cudf2opam t
 
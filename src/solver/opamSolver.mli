@@ -92,6 +92,19 @@ val resolve :
   universe -> atom request
   -> (solution, OpamCudf.conflict) result
 
+(** Staged version of {!resolve}: the CUDF translation of the universe is done
+    once, and shared by all the requests given to the returned function. Use
+    this when solving many requests against the same universe.
+
+    [requested] replaces the packages the universe was built for (see
+    {!OpamSwitchState.universe}) for a single request, as far as the query
+    marks and reinstalls are concerned. The dependencies, and thus the
+    [with-test], [with-doc] and [with-dev-setup] filters, are not
+    recomputed. *)
+val resolver :
+  universe -> ?requested:package_set -> atom request ->
+  (solution, OpamCudf.conflict) result
+
 (** Returns the graph of atomic actions (rm, inst) from a solution *)
 val get_atomic_action_graph : solution -> ActionGraph.t
 
@@ -789,11 +789,11 @@ let is_up_to_date_raw ?(skip=OpamStateConfig.(!r.no_env_notice)) updates =
   else log "Environment is up-to-date";
   r
 
-let is_up_to_date_switch root switch =
+let is_up_to_date_switch ?skip root switch =
   let env_file = OpamPath.Switch.environment root switch in
   try
     match OpamFile.Environment.read_opt env_file with
-    | Some upd -> is_up_to_date_raw upd
+    | Some upd -> is_up_to_date_raw ?skip upd
     | None -> true
   with e -> OpamStd.Exn.fatal e; true
 
@@ -83,9 +83,10 @@ val updates:
 val is_up_to_date: ?skip:bool -> 'a switch_state -> bool
 
 (** Check if the shell environment is in sync with the given opam root and
-    switch (or if OPAMNOENVNOTICE has been set, in which case we just assume
-    it's up to date) *)
-val is_up_to_date_switch: dirname -> switch -> bool
+    switch, using the environment file of the switch rather than its loaded
+    state (or if [skip], which defaults to OPAMNOENVNOTICE, has been set, in
+    which case we just assume it's up to date) *)
+val is_up_to_date_switch: ?skip:bool -> dirname -> switch -> bool
 
 (** Returns the current environment updates to configure the current switch with
     its set of installed packages *)
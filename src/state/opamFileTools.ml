@@ -1436,11 +1436,15 @@ let add_aux_files ?dir ?(files_subdir_hashes=false) opam =
     in
     opam
 
-let read_opam dir =
+let read_opam ?skip dir =
   let (opam_file: OpamFile.OPAM.t OpamFile.t) =
     OpamFile.make (dir // "opam")
   in
-  match try_read OpamFile.OPAM.read_opt opam_file with
+  let read = match skip with
+    | None -> OpamFile.OPAM.read_opt
+    | Some skip -> OpamFile.OPAM.read_skipping ~skip
+  in
+  match try_read read opam_file with
   | Some opam, None -> Some (add_aux_files ~dir ~files_subdir_hashes:false opam)
   | _, Some err ->
     OpamConsole.warning
@@ -1467,11 +1471,46 @@ let read_opam dir =
              upgrade your opam installation to at least version %s."
             sversion scurrent sversion))
 
+(* Many values are structurally identical across package definitions (e.g.
+   [ocaml {>= "4.08"}], or the standard dune build commands): they are
+   hash-consed so that they are physically shared between the loaded
+   definitions, and within the repository cache. Weak tables are used so that
+   they don't prevent collection. *)
+module Hashcons (X: sig type t end) = Weak.Make(struct
+    type t = X.t
+    let equal = ( = )
+    let hash = Hashtbl.hash
+  end)
+
+module FilterH = Hashcons(struct type t = filter end)
+module FormulaH = Hashcons(struct type t = filtered_formula end)
+module CommandH = Hashcons(struct type t = command end)
+module CommandsH = Hashcons(struct type t = command list end)
+
+let hashcons =
+  let filters = FilterH.create 1024 in
+  let formulas = FormulaH.create 4096 in
+  let command = CommandH.create 1024 in
+  let commands = CommandsH.create 1024 in
+  let commands l =
+    CommandsH.merge commands (List.map (CommandH.merge command) l)
+  in
+  fun opam ->
+    opam
+    |> with_depends (FormulaH.merge formulas (depends opam))
+    |> with_depopts (FormulaH.merge formulas (depopts opam))
+    |> with_conflicts (FormulaH.merge formulas (conflicts opam))
+    |> with_available (FilterH.merge filters (available opam))
+    |> with_build (commands (build opam))
+    |> with_install (commands (install opam))
+    |> with_remove (commands (remove opam))
+
 let read_repo_opam ~repo_name ~repo_root dir =
   let open OpamStd.Option.Op in
   read_opam dir >>|
   OpamFile.OPAM.with_metadata_dir
-    (Some (Some repo_name, OpamFilename.remove_prefix_dir repo_root dir))
+    (Some (Some repo_name, OpamFilename.remove_prefix_dir repo_root dir)) >>|
+  hashcons
 
 let dep_formula_to_string f =
   let pp =
@@ -85,13 +85,20 @@ val warns_to_json:
   ?filename:string -> (int * [`Warning|`Error] * string) list -> OpamJson.t
 
 (** Read the opam metadata from a given directory (opam file, with possible
-    overrides from url and descr files).
+    overrides from url and descr files). The fields listed in [skip] are not
+    loaded, see {!OpamFile.OPAM.read_skipping}.
     Warning: use {!read_repo_opam} instead for correctly reading files from
     repositories!*)
-val read_opam: dirname -> OpamFile.OPAM.t option
+val read_opam: ?skip:string list -> dirname -> OpamFile.OPAM.t option
+
+(** Makes the dependency formulas, availability filter and commands of the
+    given package definition physically shared with the structurally equal
+    ones of the definitions previously given to this function. *)
+val hashcons: OpamFile.OPAM.t -> OpamFile.OPAM.t
 
 (** Like {!read_opam}, but additionally fills in the [metadata_dir] info
-    correctly for the given repository. *)
+    correctly for the given repository, and shares common values with the
+    other loaded package definitions (see {!hashcons}). *)
 val read_repo_opam:
   repo_name:repository_name -> repo_root:dirname ->
   dirname -> OpamFile.OPAM.t option
@@ -116,6 +116,51 @@ let resolve_switch ?package st full_var =
   resolve_switch_raw ?package
     st.switch_global st.switch st.switch_config full_var
 
+(** Resolve the variables of installed packages that only depend on the switch
+    selections and configuration, and on the package's [.config] file. The
+    other ones (e.g. [depends], [build-id]) return [None] *)
+let resolve_package_raw gt switch switch_config full_var =
+  let module V = OpamVariable in
+  match V.Full.scope full_var with
+  | V.Full.Global | V.Full.Self -> None
+  | V.Full.Package name ->
+    match V.Full.read_from_env full_var with
+    | Some _ as c -> c
+    | None ->
+      let sel =
+        OpamStateConfig.Switch.safe_read_selections ~lock_kind:`Lock_read
+          gt switch
+      in
+      match OpamPackage.package_of_name_opt sel.sel_installed name with
+      | None -> None
+      | Some nv ->
+        let var = V.Full.variable full_var in
+        let conf =
+          OpamFile.Dot_config.safe_read
+            (OpamPath.Switch.config gt.root switch name)
+        in
+        match OpamFile.Dot_config.variable conf var with
+        | Some _ as c -> c
+        | None ->
+          let root = gt.root in
+          let dirname dir = Some (V.string (OpamFilename.Dir.to_string dir)) in
+          match V.to_string var with
+          | "installed" -> Some (V.bool true)
+          | "pinned" -> Some (V.bool (OpamPackage.has_name sel.sel_pinned name))
+          | "name" -> Some (V.string (OpamPackage.Name.to_string name))
+          | "version" ->
+            Some (V.string (OpamPackage.Version.to_string nv.version))
+          | "bin" -> dirname (OpamPath.Switch.bin root switch switch_config)
+          | "sbin" -> dirname (OpamPath.Switch.sbin root switch switch_config)
+          | "lib" -> dirname (OpamPath.Switch.lib root switch switch_config name)
+          | "man" -> dirname (OpamPath.Switch.man_dir root switch switch_config)
+          | "doc" -> dirname (OpamPath.Switch.doc root switch switch_config name)
+          | "share" ->
+            dirname (OpamPath.Switch.share root switch switch_config name)
+          | "etc" -> dirname (OpamPath.Switch.etc root switch switch_config name)
+          | "build" -> dirname (OpamPath.Switch.build root switch nv)
+          | _ -> None
+
 open OpamVariable
 
 let is_dev_package st opam =
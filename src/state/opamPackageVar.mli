@@ -52,6 +52,14 @@ val resolve_switch_raw:
   'a global_state -> switch -> OpamFile.Switch_config.t -> full_variable ->
   variable_contents option
 
+(** Resolves the variables of installed packages that can be computed from the
+    switch selections and configuration, and the package's [.config] file, so
+    that it can be used without loading the switch state. Returns [None] for
+    other variables, and for packages that are not installed. *)
+val resolve_package_raw:
+  'a global_state -> switch -> OpamFile.Switch_config.t -> full_variable ->
+  variable_contents option
+
 val is_dev_package: 'a switch_state -> OpamFile.OPAM.t -> bool
 
 (** The defaults are [true] for [build], false for [dev] and [post], and
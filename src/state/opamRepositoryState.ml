@@ -15,6 +15,20 @@ open OpamStateTypes
 let log fmt = OpamConsole.log "RSTATE" fmt
 let slog = OpamConsole.slog
 
+(* Search indexes of the repositories, along with the opam files they were
+   computed from: they are only valid as long as these are physically equal to
+   the ones of the repository state. Indexes loaded from the cache are only read
+   when first needed. *)
+let search_indexes :
+  (repository_name,
+   OpamFile.OPAM.t package_map * OpamSearchIndex.t option Lazy.t) Hashtbl.t =
+  Hashtbl.create 7
+
+let valid_search_index name opams =
+  match Hashtbl.find_opt search_indexes name with
+  | Some (indexed, index) when indexed == opams -> Lazy.force index
+  | _ -> None
+
 module Cache = struct
   type t = {
     cached_repofiles: (repository_name * OpamFile.Repo.t) list;
@@ -26,6 +40,11 @@ module Cache = struct
       let name = "repository"
     end)
 
+  module Search = OpamCached.Make (struct
+      type t = (repository_name * OpamSearchIndex.t) list
+      let name = "search index"
+    end)
+
   let remove () =
     let root = OpamStateConfig.(!r.root_dir) in
     let cache_dir = OpamPath.state_cache_dir root in
@@ -35,40 +54,69 @@ module Cache = struct
     in
     List.iter remove_cache_file (OpamFilename.files cache_dir)
 
+  (* Repository without remote are not cached, they are intended to be
+     manually edited *)
+  let filter_out_nourl rt repos_map =
+    OpamRepositoryName.Map.filter
+      (fun name _ ->
+         try
+           (OpamRepositoryName.Map.find name rt.repositories).repo_url <>
+           OpamUrl.empty
+         with Not_found -> false)
+      repos_map
+
   let marshall rt =
-    (* Repository without remote are not cached, they are intended to be
-       manually edited *)
-    let filter_out_nourl repos_map =
-      OpamRepositoryName.Map.filter
-        (fun name _ ->
-           try
-             (OpamRepositoryName.Map.find name rt.repositories).repo_url <>
-             OpamUrl.empty
-           with Not_found -> false)
-        repos_map
-    in
       { cached_repofiles =
           OpamRepositoryName.Map.bindings
-            (filter_out_nourl rt.repos_definitions);
+            (filter_out_nourl rt rt.repos_definitions);
         cached_opams =
           OpamRepositoryName.Map.bindings
-            (filter_out_nourl rt.repo_opams);
+            (filter_out_nourl rt rt.repo_opams);
       }
 
   let file rt =
     OpamPath.state_cache rt.repos_global.root
 
+  (* The search indexes are updated incrementally when possible (see
+     [load_opams_from_diff]), and rebuilt otherwise. This must be done before
+     removing the previous cache files. *)
+  let current_search_indexes rt =
+    OpamRepositoryName.Map.bindings @@
+    OpamRepositoryName.Map.mapi (fun name opams ->
+        match valid_search_index name opams with
+        | Some index -> index
+        | None ->
+          let index = OpamSearchIndex.build opams in
+          Hashtbl.replace search_indexes name
+            (opams, Lazy.from_val (Some index));
+          index)
+      (filter_out_nourl rt rt.repo_opams)
+
+  let search_file rt =
+    OpamPath.search_cache rt.repos_global.root
+
   let save rt =
+    let search = current_search_indexes rt in
     remove ();
-    C.save (file rt) (marshall rt)
+    C.save (file rt) (marshall rt);
+    Search.save (search_file rt) search
 
   let save_new rt =
-    C.save (file rt) (marshall rt)
+    C.save (file rt) (marshall rt);
+    Search.save (search_file rt) (current_search_indexes rt)
 
   let load root =
     let file = OpamPath.state_cache root in
     match C.load file with
     | Some cache ->
+      let search =
+        lazy (OpamStd.Option.default []
+                (Search.load (OpamPath.search_cache root)))
+      in
+      List.iter (fun (name, opams) ->
+          Hashtbl.replace search_indexes name
+            (opams, lazy (List.assoc_opt name (Lazy.force search))))
+        cache.cached_opams;
       Some
         (OpamRepositoryName.Map.of_list cache.cached_repofiles,
          OpamRepositoryName.Map.of_list cache.cached_opams)
@@ -118,21 +166,18 @@ let load_opams_from_dir repo_name repo_root =
   if OpamConsole.disp_status_line () || OpamConsole.verbose () then
     OpamConsole.status_line "Processing: [%s: loading data]"
       (OpamConsole.colorise `blue (OpamRepositoryName.to_string repo_name));
-  (* FIXME: why is this different from OpamPackage.list ? *)
-  let rec aux r dir =
-    if OpamFilename.exists_dir dir then
-      let fnames = Sys.readdir (OpamFilename.Dir.to_string dir) in
-      if Array.exists (fun f -> f = "opam") fnames then
-        match read_package_opam ~repo_name ~repo_root dir with
-        | Some (nv, opam) -> OpamPackage.Map.add nv opam r
-        | None -> r
-      else
-        Array.fold_left (fun r name -> aux r OpamFilename.Op.(dir / name))
-          r fnames
-    else r
+  let load acc (_, _, file) =
+    if OpamFilename.basename file <> OpamFilename.Base.of_string "opam"
+    then acc else
+    match read_package_opam ~repo_name ~repo_root (OpamFilename.dirname file)
+    with
+    | Some (nv, opam) -> OpamPackage.Map.add nv opam acc
+    | None -> acc
   in
   Fun.protect
-    (fun () -> aux OpamPackage.Map.empty (OpamRepositoryPath.packages_dir repo_root))
+    (fun () ->
+       List.fold_left load OpamPackage.Map.empty
+         (OpamPackage.scan (OpamRepositoryPath.packages_dir repo_root)))
     ~finally:OpamConsole.clear_status
 
 let load_opams_from_diff repo diffs rt =
@@ -207,6 +252,14 @@ let load_opams_from_diff repo diffs rt =
            (existing_opams, OpamFilename.Dir.Set.empty, OpamPackage.Set.empty)
            diffs
        in
+       (match Hashtbl.find_opt search_indexes repo.repo_name with
+        | Some (indexed, index) when indexed == existing_opams ->
+          Hashtbl.replace search_indexes repo.repo_name
+            (opams,
+             lazy (Option.map (fun index ->
+                 OpamSearchIndex.update index ~old:existing_opams opams)
+                 (Lazy.force index)))
+        | _ -> ());
        opams)
     ~finally:OpamConsole.clear_status
 
@@ -242,6 +295,7 @@ let cleanup rt =
   Hashtbl.iter (fun _ tmp_dir -> clean_repo_tmp tmp_dir) rt.repos_tmp;
   Hashtbl.clear rt.repos_tmp
 let load lock_kind gt =
+  OpamTrace.span ~cat:"state" "repository state load" @@ fun () ->
   log "LOAD-REPOSITORY-STATE %@ %a" (slog OpamFilename.Dir.to_string) gt.root;
   let lock = OpamFilename.flock lock_kind (OpamPath.repos_lock gt.root) in
   let repos_map =
@@ -328,6 +382,11 @@ let find_package_opt rt repo_list nv =
       | some -> fun _ -> some)
     None repo_list
 
+let search_index rt name =
+  match OpamRepositoryName.Map.find_opt name rt.repo_opams with
+  | Some opams -> valid_search_index name opams
+  | None -> None
+
 let build_index rt repo_list =
   List.fold_left (fun acc repo_name ->
       try
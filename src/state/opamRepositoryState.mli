@@ -16,7 +16,8 @@ open OpamTypes
 
 open OpamStateTypes
 
-(** Caching of repository loading (marshall of all parsed opam files) *)
+(** Caching of repository loading (marshall of all parsed opam files, and
+    their search indexes) *)
 module Cache: sig
   val save: [< rw] repos_state -> unit
   val load:
@@ -40,6 +41,11 @@ val with_:
 val find_package_opt: 'a repos_state -> repository_name list -> package ->
   (repository_name * OpamFile.OPAM.t) option
 
+(** Returns the search index of the given repository, if one is available for
+    its current package definitions. Indexes are stored along with the cache
+    (see {!Cache.save}) and kept up-to-date by {!load_opams_from_diff}. *)
+val search_index: 'a repos_state -> repository_name -> OpamSearchIndex.t option
+
 (** Given the repos state, and a list of repos to use (highest priority first),
     build a map of all existing package definitions *)
 val build_index:
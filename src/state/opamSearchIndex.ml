@@ -0,0 +1,146 @@
+(**************************************************************************)
+(*                                                                        *)
+(*    Copyright 2026 OCamlPro                                             *)
+(*                                                                        *)
+(*  All rights reserved. This file is distributed under the terms of the  *)
+(*  GNU Lesser General Public License version 2.1, with the special       *)
+(*  exception on linking described in the file LICENSE.                   *)
+(*                                                                        *)
+(**************************************************************************)
+
+open OpamParserTypes.FullPos
+open OpamTypes
+
+module SMap = OpamStd.String.Map
+module SSet = OpamStd.String.Set
+
+(* field -> word -> packages *)
+type t = package_set SMap.t SMap.t
+
+let empty = SMap.empty
+
+let fields = ["name"; "synopsis"; "description"; "tags"; "maintainer"]
+
+let canonical_field = function
+  | "descr" -> Some "description"
+  | f when List.mem f fields -> Some f
+  | _ -> None
+
+let is_indexed f = canonical_field f <> None
+
+let is_word_char = function
+  | 'a'..'z' | 'A'..'Z' | '0'..'9' | '-' | '_' -> true
+  | c -> Char.code c >= 128
+
+let add_words acc s =
+  let len = String.length s in
+  let rec aux acc i =
+    if i >= len then acc else
+    if not (is_word_char s.[i]) then aux acc (i + 1) else
+    let j =
+      try OpamStd.String.find_from (fun c -> not (is_word_char c)) s i
+      with Not_found -> len
+    in
+    aux (SSet.add (String.lowercase_ascii (String.sub s i (j - i))) acc) j
+  in
+  aux acc 0
+
+(* Same traversal as [OpamListCommand.value_strings] *)
+let rec value_words acc value =
+  match value with
+  | Bool _ | Int _ -> acc
+  | Ident s | String s -> add_words acc s
+  | Relop (_, v1, v2)
+  | Logop (_, v1, v2)
+  | Env_binding (v1, _, v2) ->
+    value_words (value_words acc v1.pelem) v2.pelem
+  | Prefix_relop (_, v) | Pfxop (_, v) ->
+    value_words acc v.pelem
+  | List l | Group l ->
+    List.fold_left (fun acc v -> value_words acc v.pelem) acc l.pelem
+  | Option (v, vl) ->
+    List.fold_left (fun acc v -> value_words acc v.pelem)
+      (value_words acc v.pelem) vl.pelem
+
+let package_words nv opam =
+  let opam =
+    OpamFile.OPAM.(with_name nv.OpamPackage.name
+                     (with_version nv.OpamPackage.version opam))
+  in
+  List.map (fun field ->
+      let words =
+        match OpamFile.OPAM.print_field_as_syntax field opam with
+        | Some v -> value_words SSet.empty v.pelem
+        | None | exception Not_found -> SSet.empty
+      in
+      field, words)
+    fields
+
+let add_package nv opam t =
+  List.fold_left (fun t (field, words) ->
+      SMap.update field (fun index ->
+          SSet.fold (fun w index ->
+              SMap.update w (OpamPackage.Set.add nv)
+                OpamPackage.Set.empty index)
+            words index)
+        SMap.empty t)
+    t (package_words nv opam)
+
+let remove_package nv opam t =
+  List.fold_left (fun t (field, words) ->
+      match SMap.find_opt field t with
+      | None -> t
+      | Some index ->
+        let index =
+          SSet.fold (fun w index ->
+              match SMap.find_opt w index with
+              | None -> index
+              | Some pkgs ->
+                let pkgs = OpamPackage.Set.remove nv pkgs in
+                if OpamPackage.Set.is_empty pkgs then SMap.remove w index
+                else SMap.add w pkgs index)
+            words index
+        in
+        SMap.add field index t)
+    t (package_words nv opam)
+
+let build opams =
+  OpamPackage.Map.fold add_package opams empty
+
+let update t ~old opams =
+  let t =
+    OpamPackage.Map.fold (fun nv opam t ->
+        match OpamPackage.Map.find_opt nv opams with
+        | Some o when o == opam -> t
+        | _ -> remove_package nv opam t)
+      old t
+  in
+  OpamPackage.Map.fold (fun nv opam t ->
+      match OpamPackage.Map.find_opt nv old with
+      | Some o when o == opam -> t
+      | _ -> add_package nv opam t)
+    opams t
+
+let query_of_pattern ~glob pat =
+  let first, last =
+    if not glob then 0, String.length pat - 1 else
+    let len = String.length pat in
+    let rec first i = if i < len && pat.[i] = '*' then first (i + 1) else i in
+    let rec last i = if i >= 0 && pat.[i] = '*' then last (i - 1) else i in
+    first 0, last (len - 1)
+  in
+  let rec only_words i =
+    i > last || is_word_char pat.[i] && only_words (i + 1)
+  in
+  if first > last || not (only_words first) then None
+  else Some (String.lowercase_ascii (String.sub pat first (last - first + 1)))
+
+let find t ~field query =
+  match canonical_field field with
+  | None -> None
+  | Some field ->
+    let contains = OpamStd.String.contains ~sub:query in
+    let index = OpamStd.Option.default SMap.empty (SMap.find_opt field t) in
+    Some (SMap.fold (fun w pkgs acc ->
+        if contains w then OpamPackage.Set.union pkgs acc else acc)
+        index OpamPackage.Set.empty)
@@ -0,0 +1,50 @@
+(**************************************************************************)
+(*                                                                        *)
+(*    Copyright 2026 OCamlPro                                             *)
+(*                                                                        *)
+(*  All rights reserved. This file is distributed under the terms of the  *)
+(*  GNU Lesser General Public License version 2.1, with the special       *)
+(*  exception on linking described in the file LICENSE.                   *)
+(*                                                                        *)
+(**************************************************************************)
+
+(** Inverted index of the words found in the text fields of the opam files of
+    a repository, used to narrow down the packages to check when searching.
+
+    Words are the maximal sequences of ASCII alphanumerical characters, ['-'],
+    ['_'] and non-ASCII bytes, indexed in lowercase. Any pattern that only
+    contains such characters and matches a field can only match within one of
+    its words: the candidates returned by {!find} are thus a superset of the
+    matching packages, that still need to be checked against the pattern. *)
+
+open OpamTypes
+
+type t
+
+(** The index of no package *)
+val empty: t
+
+(** The fields that are indexed, as accepted by
+    {!OpamFile.OPAM.print_field_as_syntax} *)
+val fields: string list
+
+(** Whether the given field (or alias) is indexed *)
+val is_indexed: string -> bool
+
+(** Builds the index of the given opam files *)
+val build: OpamFile.OPAM.t package_map -> t
+
+(** [update t ~old opams] returns the index of [opams], given that [t] is the
+    index of [old]. Only the packages whose definitions are not physically
+    equal in [old] and [opams] are re-indexed. *)
+val update:
+  t -> old:OpamFile.OPAM.t package_map -> OpamFile.OPAM.t package_map -> t
+
+(** Returns the word that must be contained in any string matched by the given
+    pattern (either a glob, as per [Re.Glob], or a plain string), or [None] if
+    the pattern can't be looked up in the index. *)
+val query_of_pattern: glob:bool -> string -> string option
+
+(** [find t ~field query] returns the packages that have a word containing
+    [query] in the given field, or [None] if the field is not indexed *)
+val find: t -> field:string -> string -> package_set option
@@ -11,6 +11,8 @@
 open OpamTypes
 open OpamStateTypes
 
+let log fmt = OpamConsole.log "STCONFIG" fmt
+
 module E = struct
 
   type OpamStd.Config.E.t +=
@@ -298,6 +300,89 @@ let load ~lock_kind opamroot =
     OpamFile.Config.(read_opt, BestEffort.read_opt) opamroot
 
 (* switches *)
+module Selections_journal = struct
+
+  let fields = [
+    "installed",
+    (fun sel -> sel.sel_installed),
+    (fun sel set -> { sel with sel_installed = set });
+    "root",
+    (fun sel -> sel.sel_roots),
+    (fun sel set -> { sel with sel_roots = set });
+    "compiler",
+    (fun sel -> sel.sel_compiler),
+    (fun sel set -> { sel with sel_compiler = set });
+    "pinned",
+    (fun sel -> sel.sel_pinned),
+    (fun sel set -> { sel with sel_pinned = set });
+  ]
+
+  let append file before after =
+    let b = Buffer.create 256 in
+    List.iter (fun (field, get, _) ->
+        let entries op set =
+          OpamPackage.Set.iter (fun nv ->
+              Printf.bprintf b "%c%s %s\n" op field (OpamPackage.to_string nv))
+            set
+        in
+        entries '+' (OpamPackage.Set.diff (get after) (get before));
+        entries '-' (OpamPackage.Set.diff (get before) (get after)))
+      fields;
+    if Buffer.length b > 0 then
+      let oc =
+        open_out_gen [Open_wronly; Open_creat; Open_append; Open_binary] 0o644
+          (OpamFilename.to_string file)
+      in
+      (* A single write, so that a crash can at most truncate the last
+         entry *)
+      OpamStd.Exn.finally (fun () -> close_out oc) @@ fun () ->
+      Buffer.output_buffer oc b
+
+  let replay file sel =
+    match OpamFilename.read file with
+    | exception (Sys_error _ | OpamSystem.File_not_found _) -> sel
+    | contents ->
+      log "Replaying the journal of the switch selections";
+      (* An entry without its final newline was truncated by a crash *)
+      let complete =
+        match String.rindex_opt contents '\n' with
+        | Some i -> i + 1
+        | None -> 0
+      in
+      if complete < String.length contents then
+        log "Ignoring truncated selections journal entry %S"
+          (String.sub contents complete (String.length contents - complete));
+      let contents = String.sub contents 0 complete in
+      List.fold_left (fun sel line ->
+          let entry =
+            match OpamStd.String.cut_at line ' ' with
+            | Some (opfield, nv) when String.length opfield > 1 ->
+              let field =
+                String.sub opfield 1 (String.length opfield - 1)
+              in
+              (match
+                 opfield.[0],
+                 List.find_opt (fun (f, _, _) -> f = field) fields,
+                 OpamPackage.of_string_opt nv
+               with
+               | ('+' | '-' as op), Some (_, get, set), Some nv ->
+                 Some (op, get, set, nv)
+               | _ -> None)
+            | _ -> None
+          in
+          match entry with
+          | Some ('+', get, set, nv) ->
+            set sel (OpamPackage.Set.add nv (get sel))
+          | Some (_, get, set, nv) ->
+            set sel (OpamPackage.Set.remove nv (get sel))
+          | None ->
+            if line <> "" then
+              log "Ignoring invalid selections journal entry %S" line;
+            sel)
+        sel (OpamStd.String.split contents '\n')
+
+end
+
 module Switch = struct
 
   let load_raw ~lock_kind root config readf switch =
@@ -324,9 +409,15 @@ module Switch = struct
       switch
 
   let safe_read_selections ~lock_kind gt switch =
-    load_if_possible ~lock_kind gt
-      OpamFile.SwitchSelections.(safe read_opt BestEffort.read_opt empty)
-      (OpamPath.Switch.selections gt.root switch)
+    let sel =
+      load_if_possible ~lock_kind gt
+        OpamFile.SwitchSelections.(safe read_opt BestEffort.read_opt empty)
+        (OpamPath.Switch.selections gt.root switch)
+    in
+    (* Left by an interrupted run, it is compacted on the next write-locked
+       load of the switch state *)
+    Selections_journal.replay
+      (OpamPath.Switch.selections_journal gt.root switch) sel
 
 end
 
@@ -134,11 +134,26 @@ val load_config_root:
   ((OpamFile.Config.t OpamFile.t -> 'b) * (OpamFile.Config.t OpamFile.t -> 'b)) ->
   dirname -> 'b
 
+(** Journal of the changes to the selections of a switch that are not yet
+    written to its state file, stored in
+    {!OpamPath.Switch.selections_journal} *)
+module Selections_journal: sig
+  (** [append file before after] records the changes from [before] to
+      [after] *)
+  val append:
+    OpamFilename.t -> switch_selections -> switch_selections -> unit
+
+  (** Applies the changes recorded in the given journal, if it exists *)
+  val replay: OpamFilename.t -> switch_selections -> switch_selections
+end
+
 module Switch : sig
   val safe_load_t:
     lock_kind: 'a lock -> dirname -> switch -> OpamFile.Switch_config.t
   val safe_load:
     lock_kind: 'a lock -> 'b global_state -> switch -> OpamFile.Switch_config.t
+  (** Reads the selections of the switch, and applies the pending changes
+      from its journal (see {!Selections_journal}) *)
   val safe_read_selections:
     lock_kind: 'a lock -> 'b global_state -> switch -> switch_selections
   val read_opt:
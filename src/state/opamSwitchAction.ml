@@ -95,7 +95,51 @@ let write_selections st =
     let f = OpamPath.Switch.selections st.switch_global.root st.switch in
     let env = OpamPath.Switch.environment st.switch_global.root st.switch in
     OpamFile.SwitchSelections.write f (OpamSwitchState.selections st);
-    OpamFile.Environment.write env (OpamEnv.compute_updates st)
+    OpamFile.Environment.write env (OpamEnv.compute_updates st);
+    OpamFilename.remove
+      (OpamPath.Switch.selections_journal st.switch_global.root st.switch)
+
+type batch = {
+  batch_switch: switch;
+  mutable batch_entries: int;
+  mutable batch_last_write: float;
+}
+
+(* Set by [with_batched_writes] *)
+let current_batch = ref None
+
+(* Bounds on the changes kept in the journal between full writes *)
+let batch_max_entries = 50
+let batch_max_delay = 5.
+
+let record_selections st old_selections =
+  match !current_batch with
+  | Some b when OpamSwitch.equal b.batch_switch st.switch ->
+    OpamStateConfig.Selections_journal.append
+      (OpamPath.Switch.selections_journal st.switch_global.root st.switch)
+      old_selections (OpamSwitchState.selections st);
+    b.batch_entries <- b.batch_entries + 1;
+    if b.batch_entries >= batch_max_entries ||
+       Unix.gettimeofday () -. b.batch_last_write >= batch_max_delay
+    then
+      (write_selections st;
+       b.batch_entries <- 0;
+       b.batch_last_write <- Unix.gettimeofday ())
+  | _ -> write_selections st
+
+let with_batched_writes st_ref f =
+  let st = !st_ref in
+  let b = {
+    batch_switch = st.switch;
+    batch_entries = 0;
+    batch_last_write = Unix.gettimeofday ();
+  } in
+  current_batch := Some b;
+  let finish () =
+    current_batch := None;
+    if b.batch_entries > 0 then write_selections !st_ref
+  in
+  OpamStd.Exn.finally finish f
 
 let add_to_reinstall st ~unpinned_only packages =
   log "add-to-reinstall unpinned_only:%b packages:%a" unpinned_only
@@ -197,7 +241,7 @@ let update_switch_state ?installed ?installed_roots ?reinstall ?pinned st =
     if not (OpamTypesBase.switch_selections_equal
               (OpamSwitchState.selections st)
               old_selections) then
-      write_selections st;
+      record_selections st old_selections;
     if not (OpamPackage.Set.equal reinstall0 reinstall) then
       OpamFile.PkgList.write
         (OpamPath.Switch.reinstall st.switch_global.root st.switch)
@@ -25,6 +25,14 @@ val create_empty_switch:
     Unless [OpamStateConfig.(!r.dryrun)] *)
 val write_selections: rw switch_state -> unit
 
+(** [with_batched_writes st_ref f] runs [f], during which the changes to the
+    selections of the switch made through {!update_switch_state} are appended to
+    its journal (see {!OpamStateConfig.Selections_journal}) rather than
+    rewriting the state and environment files each time. These are still
+    rewritten every few changes and seconds, and when [f] terminates, from the
+    contents of [st_ref], that [f] is expected to keep up-to-date. *)
+val with_batched_writes: rw switch_state ref -> (unit -> 'a) -> 'a
+
 (** Updates the global default switch to the one corresponding to the given
     state; fails and exits with a message if the switch is external *)
 val set_current_switch: rw global_state -> 'a switch_state -> 'a switch_state
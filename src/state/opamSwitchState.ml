@@ -198,7 +198,11 @@ let depexts_status_of_packages_raw
   in
   let syspkg_set = syspkg_set -- bypass in
   let ret =
-    match OpamSysInteract.packages_status ?env global_config syspkg_set with
+    let cache_file = OpamPath.depexts_cache OpamStateConfig.(!r.root_dir) in
+    match
+      OpamSysInteract.packages_status_cached ?env ~cache_file global_config
+        syspkg_set
+    with
     | status ->
       let status =
         if OpamStateConfig.(!r.no_depexts) then
@@ -234,6 +238,7 @@ let depexts_unavailable_raw sys_packages nv =
   | _ -> None
 
 let load lock_kind gt rt switch =
+  OpamTrace.span ~cat:"state" "switch state load" @@ fun () ->
   let chrono = OpamConsole.timer () in
   log "LOAD-SWITCH-STATE %@ %a" (slog OpamSwitch.to_string) switch;
   if not (OpamGlobalState.switch_exists gt switch) then
@@ -280,9 +285,10 @@ let load lock_kind gt rt switch =
       (OpamVersion.to_string (switch_config.opam_version))
       (OpamVersion.to_string
          OpamFile.Switch_config.oldest_compatible_format_version);
+  let selections = load_selections ~lock_kind gt switch in
   let { sel_installed = installed; sel_roots = installed_roots;
         sel_pinned = pinned; sel_compiler = compiler_packages; } =
-    load_selections ~lock_kind gt switch
+    selections
   in
   let pinned, pinned_opams =
     OpamPackage.Set.fold (fun nv (pinned,opams) ->
@@ -622,6 +628,20 @@ let load lock_kind gt rt switch =
     packages; available_packages; sys_packages; reinstall; invalidated;
     overwrote_opams = OpamPackage.Map.empty;
   } in
+  let journal = OpamPath.Switch.selections_journal gt.root switch in
+  (match lock_kind with
+   | `Lock_write when OpamFilename.exists journal
+                   && not OpamStateConfig.(!r.dryrun) ->
+     (* Left by an interrupted run, which didn't rewrite the state and
+        environment files for the changes it contains *)
+     log "Compacting the journal of the switch selections";
+     OpamFile.SwitchSelections.write
+       (OpamPath.Switch.selections gt.root switch) selections;
+     OpamFile.Environment.write
+       (OpamPath.Switch.environment gt.root switch)
+       (OpamEnv.compute_updates st);
+     OpamFilename.remove journal
+   | _ -> ());
   log "Switch state loaded in %.3fs" (chrono ());
   st
 
@@ -967,6 +987,7 @@ let universe st
     ?reinstall
     ~requested
     user_action =
+  OpamTrace.span ~cat:"solver" "universe build" @@ fun () ->
   let chrono = OpamConsole.timer () in
   let names = OpamPackage.names_of_packages requested in
   let requested_allpkgs =
@@ -1360,11 +1381,159 @@ let dependencies_filter_to_formula_t ~build ~post st nv =
   in
   OpamFilter.filter_formula ~default:true env
 
-let dependencies_t st base_deps_compute deps_compute
+(* Dependency graph between the packages of a set, with the forward and
+   reverse edges stored as compact adjacency arrays: the successors of node [i]
+   are [targets.(offsets.(i)) .. targets.(offsets.(i+1) - 1)] *)
+module Dep_index = struct
+
+  type t = {
+    packages: package array;
+    ids: int OpamPackage.Map.t;
+    fwd_offsets: int array;
+    fwd_targets: int array;
+    rev_offsets: int array;
+    rev_targets: int array;
+  }
+
+  let make base edges =
+    let packages = Array.of_list (OpamPackage.Set.elements base) in
+    let n = Array.length packages in
+    let ids, _ =
+      Array.fold_left (fun (ids, i) nv -> OpamPackage.Map.add nv i ids, i + 1)
+        (OpamPackage.Map.empty, 0) packages
+    in
+    let succs =
+      Array.map (fun nv ->
+          OpamPackage.Set.fold (fun d acc -> OpamPackage.Map.find d ids :: acc)
+            (edges nv) [])
+        packages
+    in
+    let fwd_offsets = Array.make (n + 1) 0 in
+    Array.iteri (fun i l ->
+        fwd_offsets.(i + 1) <- fwd_offsets.(i) + List.length l)
+      succs;
+    let fwd_targets = Array.make fwd_offsets.(n) 0 in
+    Array.iteri (fun i l ->
+        List.iteri (fun k j -> fwd_targets.(fwd_offsets.(i) + k) <- j) l)
+      succs;
+    let rev_offsets = Array.make (n + 1) 0 in
+    Array.iter (fun j -> rev_offsets.(j + 1) <- rev_offsets.(j + 1) + 1)
+      fwd_targets;
+    for i = 1 to n do
+      rev_offsets.(i) <- rev_offsets.(i) + rev_offsets.(i - 1)
+    done;
+    let rev_targets = Array.make fwd_offsets.(n) 0 in
+    let fill = Array.sub rev_offsets 0 n in
+    for i = 0 to n - 1 do
+      for e = fwd_offsets.(i) to fwd_offsets.(i + 1) - 1 do
+        let j = fwd_targets.(e) in
+        rev_targets.(fill.(j)) <- i;
+        fill.(j) <- fill.(j) + 1
+      done
+    done;
+    { packages; ids; fwd_offsets; fwd_targets; rev_offsets; rev_targets }
+
+  (* The given packages, and all the packages reachable from them *)
+  let closure t ~reverse roots =
+    let offsets, targets =
+      if reverse then t.rev_offsets, t.rev_targets
+      else t.fwd_offsets, t.fwd_targets
+    in
+    let n = Array.length t.packages in
+    let seen = Bytes.make ((n + 7) / 8) '\000' in
+    let mem i =
+      Char.code (Bytes.get seen (i lsr 3)) land (1 lsl (i land 7)) <> 0
+    in
+    let add i =
+      Bytes.set seen (i lsr 3)
+        (Char.unsafe_chr
+           (Char.code (Bytes.get seen (i lsr 3)) lor (1 lsl (i land 7))))
+    in
+    let queue = Array.make n 0 in
+    let push (len, result) i =
+      if mem i then len, result else
+        (add i; queue.(len) <- i;
+         len + 1, OpamPackage.Set.add t.packages.(i) result)
+    in
+    let len, result =
+      OpamPackage.Set.fold (fun nv acc ->
+          push acc (OpamPackage.Map.find nv t.ids))
+        roots (0, OpamPackage.Set.empty)
+    in
+    let rec aux pos (len, result) =
+      if pos >= len then result else
+      let i = queue.(pos) in
+      let acc = ref (len, result) in
+      for e = offsets.(i) to offsets.(i + 1) - 1 do
+        acc := push !acc targets.(e)
+      done;
+      aux (pos + 1) !acc
+    in
+    aux 0 (len, result)
+
+end
+
+let compute_dep_index st ~build ~post ~depopts base =
+  let timer = OpamConsole.timer () in
+  let opams =
+    OpamPackage.Set.fold (fun pkg opams ->
+        OpamPackage.Map.add pkg (OpamPackage.Map.find pkg st.opams) opams)
+      base OpamPackage.Map.empty
+  in
+  let get_deps =
+    get_dependencies_t st
+      ~force_dev_deps:false ~test:false ~doc:false
+      ~dev_setup:false ~requested_allpkgs:OpamPackage.Set.empty
+  in
+  let u_depends = get_deps OpamFile.OPAM.depends opams in
+  let u_depopts =
+    if depopts then get_deps OpamFile.OPAM.depopts opams
+    else OpamPackage.Map.empty
+  in
+  let edges nv =
+    let deps = OpamPackage.Map.find nv u_depends in
+    let deps =
+      match OpamPackage.Map.find_opt nv u_depopts with
+      | Some d -> OpamFormula.And (d, deps)
+      | None -> deps
+    in
+    match dependencies_filter_to_formula_t ~build ~post st nv deps with
+    | Empty -> OpamPackage.Set.empty
+    | f -> OpamFormula.packages base f
+  in
+  let index = Dep_index.make base edges in
+  log "dependency index of %d packages computed in %.3fs"
+    (OpamPackage.Set.cardinal base) (timer ());
+  index
+
+(* The index for the last query, to be reused by queries on the same switch
+   state, set of packages and flags. The switch state is only weakly held, so
+   that the index is dropped along with it. *)
+module Dep_index_cache = Ephemeron.K1.Make (struct
+    type t = unlocked switch_state
+    let equal = ( == )
+    let hash st = Hashtbl.hash (OpamSwitch.to_string st.switch)
+  end)
+
+let last_dep_index = Dep_index_cache.create 1
+
+let dep_index st ~build ~post ~depopts base =
+  let st = (st :> unlocked switch_state) in
+  match Dep_index_cache.find_opt last_dep_index st with
+  | Some (base', (build', post', depopts'), index)
+    when base' == base
+      && build' = build && post' = post && depopts' = depopts ->
+    index
+  | _ ->
+    let index = compute_dep_index st ~build ~post ~depopts base in
+    Dep_index_cache.reset last_dep_index;
+    Dep_index_cache.add last_dep_index st (base, (build, post, depopts), index);
+    index
+
+let dependencies_t st ~reverse ~build ~post
     ~depopts ~installed ~unavailable packages =
   if OpamPackage.Set.is_empty packages then OpamPackage.Set.empty else
   let base =
-    packages ++
     if installed then st.installed
     else if unavailable then st.packages
     else Lazy.force st.available_packages
@@ -1372,123 +1541,23 @@ let dependencies_t st base_deps_compute deps_compute
   log ~level:3 "dependencies packages=%a"
     (slog OpamPackage.Set.to_string) packages;
   let timer = OpamConsole.timer () in
-  let base_depends =
-    let filter = base_deps_compute base in
-    let get_deps =
-      get_dependencies_t st
-        ~force_dev_deps:false ~test:false ~doc:false
-        ~dev_setup:false ~requested_allpkgs:packages
-    in
-    let opams =
-      OpamPackage.Set.fold (fun pkg opams ->
-          OpamPackage.Map.add pkg (OpamPackage.Map.find pkg st.opams) opams)
-        base OpamPackage.Map.empty
-    in
-    let u_depends = get_deps OpamFile.OPAM.depends opams in
-    let depends =
-      OpamPackage.Map.filter_map filter u_depends
-    in
-    if depopts then
-      let u_depopts = get_deps OpamFile.OPAM.depopts opams in
-      let depopts =
-        OpamPackage.Map.filter_map filter u_depopts
-      in
-      OpamPackage.Map.union (fun d d' -> OpamFormula.And (d, d'))
-        depopts depends
+  let index =
+    if OpamPackage.Set.subset packages base then
+      dep_index st ~build ~post ~depopts base
     else
-      depends
+      (* Not cached, as it depends on the queried packages *)
+      compute_dep_index st ~build ~post ~depopts (packages ++ base)
   in
-  let result = deps_compute base base_depends packages in
+  let result = Dep_index.closure index ~reverse packages in
   log "dependencies (%.3f) result=%a" (timer ())
     (slog OpamPackage.Set.to_string) result;
   result
 
 let dependencies st ~build ~post =
-  dependencies_t st
-    (fun base nv ff ->
-       if OpamPackage.Set.mem nv base then Some ff else None)
-    (fun base base_depends packages ->
-       let open OpamPackage.Set.Op in
-       let get_deps nvs =
-         OpamPackage.Set.fold (fun nv set ->
-             let depends_formula =
-               dependencies_filter_to_formula_t ~build ~post st nv
-                 (OpamPackage.Map.find nv base_depends)
-             in
-             if depends_formula = Empty then set else
-             let deps = OpamFormula.packages base depends_formula in
-             if OpamPackage.Set.is_empty deps then set else
-               deps ++ set)
-           nvs OpamPackage.Set.empty
-       in
-       let rec aux all deps =
-         let new_deps = get_deps deps in
-         if OpamPackage.Set.is_empty new_deps then all
-         else aux (all ++ new_deps) (new_deps -- all)
-       in
-       aux packages packages)
+  dependencies_t st ~reverse:false ~build ~post
 
 let reverse_dependencies st ~build ~post =
-  dependencies_t st
-    (fun base nv ff ->
-       if OpamPackage.Set.mem nv base then
-         Some (dependencies_filter_to_formula_t ~build ~post st nv ff)
-       else None)
-    (fun base base_depends packages ->
-       let base_int_pkg =
-         OpamPackage.Set.fold (fun nv map ->
-             OpamStd.IntMap.add (Hashtbl.hash nv) nv map)
-           base OpamStd.IntMap.empty
-       in
-       let rev_deps =
-         OpamPackage.Map.fold (fun nv depends_formula rev_deps ->
-             let depends =
-               OpamPackage.Set.fold (fun nv deps ->
-                   Hashtbl.hash nv :: deps)
-                 (OpamFormula.packages base depends_formula) []
-             in
-             List.fold_left (fun rev_deps rev_nv ->
-                 OpamStd.IntMap.update rev_nv
-                   (fun l -> Hashtbl.hash nv :: l)
-                   [] rev_deps)
-               rev_deps depends)
-           base_depends OpamStd.IntMap.empty
-       in
-       let open OpamStd.IntSet.Op in
-       let get_revdeps all done_ packages =
-         OpamStd.IntSet.fold (fun nv (all, done_, remaining) ->
-             if OpamStd.IntSet.mem nv done_ then
-               all, done_, remaining
-             else
-             match OpamStd.IntMap.find_opt nv rev_deps with
-             | Some deps ->
-               let deps = (OpamStd.IntSet.of_list deps) in
-               deps ++ all,
-               OpamStd.IntSet.add nv done_,
-               deps ++ remaining
-             | None -> all, done_, remaining)
-           packages (all, done_, OpamStd.IntSet.empty)
-       in
-       let rec aux all done_ remaining =
-         let all, done_, remaining =
-           get_revdeps all done_ remaining
-         in
-         if OpamStd.IntSet.is_empty remaining then all else
-           aux all done_ remaining
-       in
-       let int_revdeps =
-         let packages =
-           OpamPackage.Set.fold (fun nv set ->
-               OpamStd.IntSet.add (Hashtbl.hash nv) set)
-             packages OpamStd.IntSet.empty
-         in
-         aux OpamStd.IntSet.empty OpamStd.IntSet.empty packages
-       in
-       OpamStd.IntSet.fold (fun hash result ->
-           match OpamStd.IntMap.find_opt hash base_int_pkg with
-           | Some nv -> OpamPackage.Set.add nv result
-           | None -> OpamStd.Sys.exit_because `Internal_error)
-         int_revdeps packages)
+  dependencies_t st ~reverse:true ~build ~post
 
 (* invariant computation *)
 
@@ -43,7 +43,8 @@ val load_virtual:
   'a global_state -> 'b repos_state -> unlocked switch_state
 
 (** Load the switch's state file, without constructing the package maps: much
-    faster than loading the full switch state *)
+    faster than loading the full switch state. Pending changes from the journal
+    (see {!OpamStateConfig.Selections_journal}) are applied. *)
 val load_selections:
   lock_kind: 'a lock -> 'b global_state -> switch -> switch_selections
 
@@ -9,6 +9,7 @@
 (**************************************************************************)
 
 let log fmt = OpamConsole.log "XSYS" fmt
+let slog = OpamConsole.slog
 
 (* Run commands *)
 (* Always call this function to run a command, as it handles `dryrun` option *)
@@ -1002,6 +1003,116 @@ let packages_status ?(env=OpamVariable.Map.empty) config packages =
     in
     compute_sets sys_installed
 
+(* Cached status *)
+
+(* Files and directories modified by the system package manager when packages
+   are installed or removed, or when its package lists are updated. Families
+   not listed here, and Cygwin and MSYS2 when their location is not
+   configured, are not cached. *)
+let package_db_paths ~env config =
+  let open OpamFilename.Op in
+  match family ~env () with
+  | exception Failure _ -> []
+  | Alpine -> ["/lib/apk/db/installed"; "/etc/apk/repositories";
+               "/var/cache/apk"]
+  | Altlinux -> ["/var/lib/rpm"; "/var/lib/apt/lists"]
+  | Arch -> ["/var/lib/pacman/local"; "/var/lib/pacman/sync"]
+  | Centos -> ["/var/lib/rpm"; "/usr/lib/sysimage/rpm";
+               "/var/cache/dnf"; "/var/cache/yum"]
+  | Debian -> ["/var/lib/dpkg/status"; "/var/lib/apt/lists";
+               "/var/cache/apt/pkgcache.bin"]
+  | Freebsd -> ["/var/db/pkg"]
+  | Gentoo -> ["/var/db/pkg"; "/var/db/repos/gentoo"]
+  | Suse -> ["/var/lib/rpm"; "/usr/lib/sysimage/rpm"; "/var/cache/zypp"]
+  | Cygwin ->
+    (match Cygwin.cygroot_opt config with
+     | Some root ->
+       [OpamFilename.to_string (root / "etc" / "setup" // "installed.db")]
+     | None -> [])
+  | Msys2 ->
+    (* pacman is in <root>/usr/bin *)
+    (match Cygwin.msys2bin_opt config with
+     | Some bin ->
+       let db = OpamFilename.dirname_dir (OpamFilename.dirname_dir bin)
+                / "var" / "lib" / "pacman" in
+       [OpamFilename.Dir.to_string (db / "local");
+        OpamFilename.Dir.to_string (db / "sync")]
+     | None -> [])
+  | Dummy _ | Homebrew | Macports | Netbsd | Nix | Openbsd -> []
+
+(* Fingerprint of the system package database, from the modification times of
+   [package_db_paths] and of their direct contents, and of the package manager
+   commands overridden in [config] *)
+let package_db_fingerprint ~env config =
+  let b = Buffer.create 1024 in
+  let stamp path =
+    match Unix.stat path with
+    | exception Unix.Unix_error _ -> ()
+    | st ->
+      Printf.bprintf b "%s:%.6f:%d\n" path st.Unix.st_mtime st.Unix.st_size;
+      if st.Unix.st_kind = Unix.S_DIR then
+        let entries = try Sys.readdir path with Sys_error _ -> [||] in
+        Array.sort String.compare entries;
+        Array.iter (fun f ->
+            match Unix.stat (Filename.concat path f) with
+            | exception Unix.Unix_error _ -> ()
+            | st ->
+              Printf.bprintf b "%s:%.6f:%d\n" f
+                st.Unix.st_mtime st.Unix.st_size)
+          entries
+  in
+  List.iter stamp (package_db_paths ~env config);
+  if Buffer.length b = 0 then None else
+  let () =
+    OpamStd.String.Map.iter (fun family cmd ->
+        Printf.bprintf b "%s=%s\n" family (OpamFilename.to_string cmd))
+      (OpamFile.Config.sys_pkg_manager_cmd config)
+  in
+  Some (String.concat ":"
+          [OpamStd.Option.default "" (OpamSysPoll.os_family env);
+           Digest.to_hex (Digest.string (Buffer.contents b))])
+
+module Status_cache = OpamCached.Make(struct
+    (* fingerprint, installed packages, status of the others *)
+    type t = string * OpamSysPkg.Set.t * OpamSysPkg.status
+    let name = "depexts"
+  end)
+
+let packages_status_cached ?(env=OpamVariable.Map.empty) ~cache_file config
+    packages =
+  match package_db_fingerprint ~env config with
+  | None -> packages_status ~env config packages
+  | Some fingerprint ->
+    let open OpamSysPkg.Set.Op in
+    let installed, known =
+      match Status_cache.load cache_file with
+      | Some (fp, installed, known) when fp = fingerprint -> installed, known
+      | Some _ | None -> OpamSysPkg.Set.empty, OpamSysPkg.status_empty
+    in
+    let unknown =
+      packages -- installed
+      -- known.OpamSysPkg.s_available -- known.OpamSysPkg.s_not_found
+    in
+    let known =
+      if OpamSysPkg.Set.is_empty unknown then known else
+      let status = packages_status ~env config unknown in
+      log "Status of %d system packages not in cache: %a"
+        (OpamSysPkg.Set.cardinal unknown)
+        (slog OpamSysPkg.Set.to_string) unknown;
+      let known = { OpamSysPkg.
+        s_available = known.OpamSysPkg.s_available ++ status.s_available;
+        s_not_found = known.s_not_found ++ status.s_not_found;
+      } in
+      let installed =
+        installed ++ (unknown -- status.s_available -- status.s_not_found)
+      in
+      Status_cache.save cache_file (fingerprint, installed, known);
+      known
+    in
+    { OpamSysPkg.
+      s_available = packages %% known.s_available;
+      s_not_found = packages %% known.s_not_found }
+
 let stateless_install ?(env=OpamVariable.Map.empty) () =
   match family ~env () with
   | exception Failure _ -> true (* no depexts *)
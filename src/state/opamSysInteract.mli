@@ -21,6 +21,14 @@ val packages_status:
   ?env:gt_variables -> OpamFile.Config.t -> OpamSysPkg.Set.t ->
   OpamSysPkg.status
 
+(* As {!packages_status}, but stores the results in [cache_file], which is
+   valid as long as the package database of the system is unchanged. Only the
+   packages missing from the cache are queried. For distributions where that
+   database can't be fingerprinted, this is the same as {!packages_status}. *)
+val packages_status_cached:
+  ?env:gt_variables -> cache_file:OpamFilename.t -> OpamFile.Config.t ->
+  OpamSysPkg.Set.t -> OpamSysPkg.status
+
 (* Returns [true] if the distribution is a stateless installation. It permits to
    define where there is a need to handle installed system packages or not. *)
 val stateless_install: ?env:gt_variables -> unit -> bool
@@ -56,6 +56,37 @@ let () =
     in
     List.fold_left (+.) 0.0 l /. float_of_int n
   in
+  let time_OpamFile_OPAM_read ?skip n =
+    Gc.compact ();
+    let files =
+      let ic = Stdlib.open_in_bin "/home/opam/all-opam-files" in
+      let rec loop files =
+        match Stdlib.input_line ic with
+        | file -> loop (OpamFile.make (OpamFilename.of_string file) :: files)
+        | exception End_of_file -> files
+      in
+      loop []
+    in
+    let read = match skip with
+      | None -> OpamFile.OPAM.read_opt
+      | Some skip -> OpamFile.OPAM.read_skipping ~skip
+    in
+    let l = List.init n (fun _ ->
+        let before = Unix.gettimeofday () in
+        List.iter (fun file -> ignore (read file)) files;
+        Unix.gettimeofday () -. before)
+    in
+    List.fold_left (+.) 0.0 l /. float_of_int n
+  in
+  let time_OpamFile_OPAM_read_opt_10 =
+    time_OpamFile_OPAM_read 10
+  in
+  let time_OpamFile_OPAM_read_skipping_10 =
+    time_OpamFile_OPAM_read
+      ~skip:["synopsis"; "description"; "build"; "install"; "remove";
+             "run-test"; "messages"; "post-messages"]
+      10
+  in
   let time_deps_only_installed_pkg =
     (* NOTE: https://github.com/ocaml/opam/pull/5908 *)
     Gc.compact ();
@@ -230,6 +261,16 @@ let () =
           "value": %f,
           "units": "secs"
         },
+        {
+          "name": "OpamFile.OPAM.read_opt amortised over 10 runs",
+          "value": %f,
+          "units": "secs"
+        },
+        {
+          "name": "OpamFile.OPAM.read_skipping descriptions and commands amortised over 10 runs",
+          "value": %f,
+          "units": "secs"
+        },
         {
           "name": "Deps-only install of an already installed package",
           "value": %f,
@@ -353,6 +394,8 @@ let () =
       time_install_cmd
       time_install_cmd_w_invariant
       time_OpamSystem_read_100
+      time_OpamFile_OPAM_read_opt_10
+      time_OpamFile_OPAM_read_skipping_10
       time_deps_only_installed_pkg
       time_OpamPackage_Version_compare_100
       time_install_check_installed
@@ -0,0 +1,373 @@
+(* Micro-benchmarks of the core engines of opam, run on generated data: unlike
+   bench.ml, they need neither network access nor a specific environment.
+
+   The results are printed in the same JSON format as bench.ml, and can be
+   compared against a previous run with [--baseline]. *)
+
+open OpamTypes
+open OpamProcess.Job.Op
+
+let fmt = Printf.sprintf
+
+(* {2 Configuration} *)
+
+let packages = ref 500
+let versions = ref 5
+let depth = ref 8
+let fanout = ref 4
+let filter_density = ref 0.2
+let files = ref 2000
+let hash_size = ref 64
+let runs = ref 5
+let seed = ref 42
+let baseline = ref None
+let threshold = ref 0.1
+let output = ref None
+
+let args = [
+  "--packages", Arg.Set_int packages,
+  "N number of package names in the generated repository";
+  "--versions", Arg.Set_int versions, "N number of versions of each package";
+  "--depth", Arg.Set_int depth, "N number of layers of the dependency graph";
+  "--fanout", Arg.Set_int fanout,
+  "N number of dependencies of each package version";
+  "--filter-density", Arg.Set_float filter_density,
+  "P proportion of dependencies with a filter (0. to 1.)";
+  "--files", Arg.Set_int files, "N number of files in the tracked directory";
+  "--hash-size", Arg.Set_int hash_size, "N size of the hashed file, in MiB";
+  "--runs", Arg.Set_int runs, "N number of runs of each benchmark";
+  "--seed", Arg.Set_int seed, "N random seed";
+  "--baseline", Arg.String (fun f -> baseline := Some f),
+  "FILE compare the results with those of a previous run, stored in FILE";
+  "--threshold", Arg.Set_float threshold,
+  "P relative increase over the baseline reported as a regression \
+   (default 0.1)";
+  "--output", Arg.String (fun f -> output := Some f),
+  "FILE write the results to FILE instead of stdout";
+]
+
+(* {2 Generation of the synthetic data} *)
+
+let package_name i = fmt "pkg%d" i
+
+(* Packages are spread over [depth] layers, and only depend on packages of
+   lower layers *)
+let layer i = i * !depth / !packages
+
+let version_string k = fmt "1.%d" k
+
+let opam_file rand i =
+  let b = Buffer.create 512 in
+  Buffer.add_string b
+    "opam-version: \"2.0\"\n\
+     synopsis: \"Synthetic package\"\n\
+     maintainer: \"bench@example.com\"\n\
+     depends: [\n";
+  let first_of_layer = (layer i * !packages + !depth - 1) / !depth in
+  if first_of_layer > 0 then
+    for _ = 1 to !fanout do
+      let dep = Random.State.int rand first_of_layer in
+      let constr =
+        fmt ">= %S" (version_string (Random.State.int rand !versions))
+      in
+      let constr =
+        if Random.State.float rand 1. >= !filter_density then constr
+        else match Random.State.int rand 3 with
+          | 0 -> constr ^ " & with-test"
+          | 1 -> constr ^ " & build"
+          | _ -> constr ^ " & os = \"linux\""
+      in
+      Printf.bprintf b "  %S {%s}\n" (package_name dep) constr
+    done;
+  Buffer.add_string b
+    "]\n\
+     build: [\n\
+    \  [\"./configure\" \"--prefix=%{prefix}%\"]\n\
+    \  [make \"-j%{jobs}%\"]\n\
+    \  [make \"test\"] {with-test}\n\
+     ]\n\
+     install: [make \"install\"]\n";
+  Buffer.contents b
+
+let generate_repository dir =
+  let rand = Random.State.make [| !seed |] in
+  OpamFilename.write OpamFilename.Op.(dir // "repo") "opam-version: \"2.0\"\n";
+  for i = 0 to !packages - 1 do
+    let name = package_name i in
+    for k = 0 to !versions - 1 do
+      let pkg_dir =
+        OpamFilename.Op.(dir / "packages" / name
+                         / fmt "%s.%s" name (version_string k))
+      in
+      OpamFilename.write OpamFilename.Op.(pkg_dir // "opam") (opam_file rand i)
+    done
+  done
+
+let generate_tree dir =
+  let per_dir = 50 in
+  for i = 0 to !files - 1 do
+    let d = OpamFilename.Op.(dir / fmt "d%d" (i / per_dir)) in
+    OpamFilename.write OpamFilename.Op.(d // fmt "f%d" i) (fmt "content %d\n" i)
+  done
+
+let generate_blob file =
+  let rand = Random.State.make [| !seed |] in
+  let chunk = 1 lsl 20 in
+  let oc = open_out_bin (OpamFilename.to_string file) in
+  for _ = 1 to !hash_size do
+    output_string oc
+      (String.init chunk (fun _ -> Char.chr (Random.State.int rand 256)))
+  done;
+  close_out oc
+
+let generate_versions () =
+  let rand = Random.State.make [| !seed |] in
+  let pick l = List.nth l (Random.State.int rand (List.length l)) in
+  List.init (!packages * !versions * 10) (fun _ ->
+      fmt "%s%d.%d.%d%s"
+        (pick [""; ""; "v"])
+        (Random.State.int rand 5) (Random.State.int rand 20)
+        (Random.State.int rand 10)
+        (pick [""; ""; ""; "~beta1"; "~rc2"; "+dev"; "-1"; ".20240101"]))
+
+(* {2 Measures} *)
+
+type measure = {
+  name: string;
+  time: float; (* seconds per run *)
+  minor_words: float; (* per run *)
+  major_words: float; (* per run *)
+  minor_collections: float; (* per run *)
+  major_collections: float; (* per run *)
+}
+
+let measure name f =
+  ignore (Sys.opaque_identity (f ())); (* warm-up *)
+  Gc.compact ();
+  let n = float_of_int !runs in
+  let s0 = Gc.quick_stat () in
+  let t0 = Unix.gettimeofday () in
+  for _ = 1 to !runs do ignore (Sys.opaque_identity (f ())) done;
+  let time = (Unix.gettimeofday () -. t0) /. n in
+  let s1 = Gc.quick_stat () in
+  { name; time;
+    minor_words = (s1.Gc.minor_words -. s0.Gc.minor_words) /. n;
+    major_words = (s1.Gc.major_words -. s0.Gc.major_words) /. n;
+    minor_collections =
+      float_of_int (s1.Gc.minor_collections - s0.Gc.minor_collections) /. n;
+    major_collections =
+      float_of_int (s1.Gc.major_collections - s0.Gc.major_collections) /. n;
+  }
+
+module Vertex = struct
+  type t = int
+  let compare = Int.compare
+  let equal = Int.equal
+  let hash = Hashtbl.hash
+  let to_string = string_of_int
+  let to_json i = `Float (float_of_int i)
+  let of_json = function `Float f -> Some (int_of_float f) | _ -> None
+end
+
+module Graph = OpamParallel.MakeGraph(Vertex)
+
+module Cache = OpamCached.Make(struct
+    type t = OpamFile.OPAM.t OpamPackage.Map.t
+    let name = "synthetic"
+  end)
+
+let benchmarks tmp =
+  let repo_dir = OpamFilename.Op.(tmp / "repo") in
+  generate_repository repo_dir;
+  let repo_name = OpamRepositoryName.of_string "synthetic" in
+  let load_repo () =
+    OpamRepositoryState.load_opams_from_dir repo_name repo_dir
+  in
+  let opams = load_repo () in
+  let cache_file = OpamFilename.Op.(tmp // "synthetic.cache") in
+  let packages = OpamPackage.keys opams in
+  let universe () =
+    { OpamSolver.empty_universe with
+      u_packages = packages;
+      u_available = Lazy.from_val packages;
+      u_depends = OpamPackage.Map.map OpamFile.OPAM.depends opams;
+      u_depopts = OpamPackage.Map.map OpamFile.OPAM.depopts opams;
+      u_conflicts =
+        OpamPackage.Map.map (fun opam ->
+            OpamFilter.filter_formula ~default:false (fun _ -> None)
+              (OpamFile.OPAM.conflicts opam))
+          opams;
+      u_action = Install;
+    }
+  in
+  let load_cudf_universe () =
+    let u = universe () in
+    let version_map = OpamSolver.cudf_versions_map u in
+    OpamSolver.load_cudf_universe u ~version_map packages
+      ~build:true ~post:true ()
+  in
+  let cudf_universe = load_cudf_universe () in
+  let cudf_request =
+    (* Install the last version of every package of the top layer *)
+    let top =
+      OpamPackage.Name.Set.of_list
+        (List.filter_map (fun i ->
+             if layer i = !depth - 1 then
+               Some (OpamPackage.Name.of_string (package_name i))
+             else None)
+            (List.init !packages (fun i -> i)))
+    in
+    let wish_install =
+      List.fold_left (fun acc p ->
+          let nv = OpamCudf.cudf2opam p in
+          if OpamPackage.Name.Set.mem (OpamPackage.name nv) top
+          && not (List.mem (p.Cudf.package, None) acc) then
+            (p.Cudf.package, None) :: acc
+          else acc)
+        [] (Cudf.get_packages cudf_universe)
+    in
+    OpamCudf.to_cudf cudf_universe {
+      criteria = `Default;
+      wish_install = OpamFormula.ands (List.map (fun a -> Atom a) wish_install);
+      wish_remove = [];
+      wish_upgrade = [];
+      wish_all = [];
+      extra_attributes = [];
+    }
+  in
+  let criteria =
+    "-removed,-count[version-lag,request],-count[version-lag,changed],-changed"
+  in
+  let graph =
+    let g = Graph.create () in
+    OpamPackage.Map.iter (fun nv opam ->
+        let i = Hashtbl.hash (OpamPackage.to_string nv) in
+        Graph.add_vertex g i;
+        OpamFormula.iter (fun (name, _) ->
+            let dep_version =
+              OpamPackage.Version.of_string (version_string (!versions - 1))
+            in
+            let dep = OpamPackage.create name dep_version in
+            Graph.add_edge g (Hashtbl.hash (OpamPackage.to_string dep)) i)
+          (OpamFilter.filter_deps ~build:true ~post:false ~default:true
+             (OpamFile.OPAM.depends opam)))
+      opams;
+    g
+  in
+  let tree_dir = OpamFilename.Op.(tmp / "tree") in
+  generate_tree tree_dir;
+  let versions = generate_versions () in
+  let blob = OpamFilename.Op.(tmp // "blob") in
+  generate_blob blob;
+  let blob = OpamFilename.to_string blob in
+  let tree_files =
+    List.map OpamFilename.to_string (OpamFilename.rec_files tree_dir)
+  in
+  [
+    measure "OpamRepositoryState.load_opams_from_dir" load_repo;
+    measure "OpamCached save" (fun () -> Cache.save cache_file opams);
+    measure "OpamCached load" (fun () -> Cache.load cache_file);
+    measure "OpamSolver.load_cudf_universe" load_cudf_universe;
+    measure "OpamCudf.preprocess_cudf_request" (fun () ->
+        OpamCudf.preprocess_cudf_request cudf_request criteria);
+    measure "OpamParallel scheduling of the dependency graph" (fun () ->
+        Graph.Parallel.iter ~jobs:8 ~command:(fun ~pred:_ _ -> Done ()) graph);
+    measure "OpamDirTrack.track" (fun () ->
+        OpamProcess.Job.run (OpamDirTrack.track tree_dir (fun () -> Done ())));
+    measure "OpamVersionCompare.compare (sort)" (fun () ->
+        List.stable_sort OpamVersionCompare.compare versions);
+    (* The [sha] library is the implementation OpamSHA used before its own
+       kernels, kept as a reference for their throughput *)
+    measure (fmt "OpamSHA.sha256_file (%dMiB)" !hash_size) (fun () ->
+        OpamSHA.sha256_file blob);
+    measure (fmt "Sha256.file (%dMiB, reference)" !hash_size) (fun () ->
+        Sha256.to_hex (Sha256.file blob));
+    measure "OpamSHA.sha256_file (tracked directory)" (fun () ->
+        List.map OpamSHA.sha256_file tree_files);
+    measure "Sha256.file (tracked directory, reference)" (fun () ->
+        List.map (fun f -> Sha256.to_hex (Sha256.file f)) tree_files);
+  ]
+
+(* {2 Output and comparison} *)
+
+let metric name value units =
+  `O ["name", `String name; "value", `Float value; "units", `String units]
+
+let to_json measures =
+  let group name f =
+    `O ["name", `String name;
+        "metrics", `A (List.flatten (List.map f measures))]
+  in
+  `O ["results", `A [
+      group "Synthetic timings" (fun m -> [metric m.name m.time "secs"]);
+      group "Synthetic allocations" (fun m -> [
+            metric (m.name ^ " (minor)") m.minor_words "words";
+            metric (m.name ^ " (major)") m.major_words "words";
+          ]);
+      group "Synthetic collections" (fun m -> [
+            metric (m.name ^ " (minor)") m.minor_collections "collections";
+            metric (m.name ^ " (major)") m.major_collections "collections";
+          ]);
+    ]]
+
+(* Returns the (group, metric name) -> value associations of a result file *)
+let metrics_of_json json =
+  let field name = function
+    | `O fields -> List.assoc_opt name fields
+    | _ -> None
+  in
+  match field "results" json with
+  | Some (`A groups) ->
+    List.flatten @@ List.map (fun group ->
+        match field "name" group, field "metrics" group with
+        | Some (`String gname), Some (`A metrics) ->
+          List.filter_map (fun m ->
+              match field "name" m, field "value" m with
+              | Some (`String name), Some (`Float v) -> Some ((gname, name), v)
+              | _ -> None)
+            metrics
+        | _ -> [])
+      groups
+  | _ -> []
+
+(* Prints the comparison with the baseline, and returns the number of
+   regressions *)
+let compare_with_baseline file json =
+  let baseline =
+    match OpamJson.of_string (OpamSystem.read file) with
+    | Some json -> metrics_of_json json
+    | None -> failwith (fmt "Could not parse baseline %s" file)
+  in
+  List.fold_left (fun regressions (key, value) ->
+      match List.assoc_opt key baseline with
+      | None -> regressions
+      | Some base ->
+        let ratio = if base > 0. then value /. base else 1. in
+        let regressed = ratio > 1. +. !threshold in
+        Printf.eprintf "%s %-70s %+6.1f%%\n"
+          (if regressed then "REGRESSION" else "          ")
+          (fmt "%s: %s" (fst key) (snd key))
+          ((ratio -. 1.) *. 100.);
+        if regressed then regressions + 1 else regressions)
+    0 (metrics_of_json json)
+
+let () =
+  Arg.parse (Arg.align args)
+    (fun a -> raise (Arg.Bad (fmt "unexpected argument %s" a)))
+    "synthetic.exe [options]";
+  OpamCoreConfig.init ();
+  OpamFormatConfig.init ();
+  let measures = OpamFilename.with_tmp_dir benchmarks in
+  let json = to_json measures in
+  let contents = OpamJson.to_string ~minify:false json in
+  (match !output with
+   | Some f -> OpamSystem.write f contents
+   | None -> print_endline contents);
+  match !baseline with
+  | None -> ()
+  | Some f ->
+    let regressions = compare_with_baseline f json in
+    if regressions > 0 then
+      (Printf.eprintf "%d regression(s) over %.0f%% of the baseline\n"
+         regressions (!threshold *. 100.);
+       exit 1)
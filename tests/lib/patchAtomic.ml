@@ -0,0 +1,80 @@
+(* Checks that a patch whose last hunk doesn't apply leaves the files touched by
+   the previous diffs unchanged *)
+
+let test_dir = "patch-atomic-test"
+
+let write file contents =
+  let oc = open_out_bin file in
+  output_string oc contents;
+  close_out oc
+
+let read file =
+  let ic = open_in_bin file in
+  let s = really_input_string ic (in_channel_length ic) in
+  close_in ic;
+  s
+
+let lines prefix l =
+  String.concat "" (List.map (Printf.sprintf "%s %d\n" prefix) l)
+
+let print_directory dir =
+  let files = Sys.readdir dir in
+  Array.sort compare files;
+  Array.iter (fun f ->
+      Printf.printf "  %s:\n" f;
+      List.iter (Printf.printf "    %s\n")
+        (OpamStd.String.split (read (Filename.concat dir f)) '\n'))
+    files
+
+let patch ~last_hunk =
+  Printf.sprintf
+    "--- a/one\n\
+     +++ b/one\n\
+     @@ -1,3 +1,3 @@\n\
+    \ Line 1\n\
+     -Line 2\n\
+     +Changed 2\n\
+    \ Line 3\n\
+     --- a/two\n\
+     +++ b/two\n\
+     @@ -3,3 +3,3 @@\n\
+    \ Line 3\n\
+     -Line 4\n\
+     +Changed 4\n\
+    \ Line 5\n\
+     --- /dev/null\n\
+     +++ b/four\n\
+     @@ -0,0 +1 @@\n\
+     +New file\n\
+     --- a/three\n\
+     +++ b/three\n\
+     @@ -2,3 +2,3 @@\n\
+    \ Line 2\n\
+     -%s\n\
+     +Changed 3\n\
+    \ Line 4\n"
+    last_hunk
+
+let apply ~last_hunk dir =
+  let patch_file = Filename.concat test_dir "atomic.patch" in
+  write patch_file (patch ~last_hunk);
+  let diffs = OpamSystem.parse_patch ~dir ~file:patch_file in
+  (match OpamSystem.patch ~allow_unclean:false ~dir diffs with
+   | () -> print_endline "Patch applied"
+   | exception _ -> print_endline "Patch failed");
+  Sys.remove patch_file;
+  print_directory dir
+
+let () =
+  let dir = Filename.concat test_dir "repo" in
+  OpamSystem.remove test_dir;
+  OpamSystem.mkdir dir;
+  List.iter (fun f -> write (Filename.concat dir f) (lines "Line" [1;2;3;4;5]))
+    ["one"; "two"; "three"];
+  print_endline "Initial files:";
+  print_directory dir;
+  print_endline "Last hunk not matching:";
+  apply ~last_hunk:"Not there" dir;
+  print_endline "All hunks matching:";
+  apply ~last_hunk:"Line 3" dir;
+  OpamSystem.remove test_dir
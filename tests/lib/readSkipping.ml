@@ -0,0 +1,67 @@
+(**************************************************************************)
+(*                                                                        *)
+(*    Copyright 2026 OCamlPro                                             *)
+(*                                                                        *)
+(*  All rights reserved. This file is distributed under the terms of the  *)
+(*  GNU Lesser General Public License version 2.1, with the special       *)
+(*  exception on linking described in the file LICENSE.                   *)
+(*                                                                        *)
+(**************************************************************************)
+
+(* Checks that [OpamFile.OPAM.read_skipping] reports errors like [read_opt] *)
+
+let test_dir = OpamFilename.Dir.of_string "read-skipping-test"
+
+let write name contents : OpamFile.OPAM.t OpamFile.t =
+  let f = OpamFilename.Op.(test_dir // name) in
+  OpamFilename.write f contents;
+  OpamFile.make f
+
+let read ?skip name file =
+  Printf.printf "%s%s: " name
+    (match skip with None -> "" | Some _ -> " (skipping build)");
+  let read = match skip with
+    | None -> OpamFile.OPAM.read_opt
+    | Some skip -> OpamFile.OPAM.read_skipping ~skip
+  in
+  match read file with
+  | Some opam ->
+    Printf.printf "read, synopsis %S, %s\n"
+      (OpamStd.Option.default "" (OpamFile.OPAM.synopsis opam))
+      (if OpamFile.OPAM.format_errors opam = [] then "no format errors"
+       else "format errors")
+  | None -> print_endline "not found"
+  | exception OpamPp.Bad_format _ -> print_endline "Bad_format"
+  | exception OpamPp.Bad_version (_, v) ->
+    Printf.printf "Bad_version %s\n"
+      (OpamStd.Option.to_string OpamVersion.to_string v)
+  | exception OpamStd.Sys.Exit code -> Printf.printf "exit %d\n" code
+
+let () =
+  OpamFilename.rmdir test_dir;
+  OpamFilename.mkdir test_dir;
+  let good =
+    write "good.opam"
+      "opam-version: \"2.0\"\nsynopsis: \"Good\"\nbuild: 42\n"
+  in
+  let malformed =
+    write "malformed.opam" "opam-version: \"2.0\"\nsynopsis: [\n"
+  in
+  let future =
+    write "future.opam"
+      "opam-version: \"50.0\"\nsynopsis: \"Future\"\nGARBAGE\n"
+  in
+  let missing = OpamFile.make OpamFilename.Op.(test_dir // "missing.opam") in
+  read "good" good;
+  read ~skip:["build"] "good" good;
+  read "malformed" malformed;
+  read ~skip:["build"] "malformed" malformed;
+  read "future" future;
+  read ~skip:["build"] "future" future;
+  read "missing" missing;
+  read ~skip:["build"] "missing" missing;
+  print_endline "Strict mode:";
+  OpamFormatConfig.update ~strict:true ();
+  read ~skip:["build"] "malformed" malformed;
+  read ~skip:["build"] "future" future;
+  OpamFilename.rmdir test_dir
@@ -0,0 +1,58 @@
+(**************************************************************************)
+(*                                                                        *)
+(*    Copyright 2026 OCamlPro                                             *)
+(*                                                                        *)
+(*  All rights reserved. This file is distributed under the terms of the  *)
+(*  GNU Lesser General Public License version 2.1, with the special       *)
+(*  exception on linking described in the file LICENSE.                   *)
+(*                                                                        *)
+(**************************************************************************)
+
+(* Known-answer tests for the SHA-256 stubs, with the hardware-accelerated
+   kernel when the machine has one, and with the portable one. The lengths
+   around 56 and 64 bytes exercise the padding and block boundaries. *)
+
+let strings = [
+  "empty", "";
+  "abc", "abc";
+  "55 bytes", String.make 55 'a';
+  "56 bytes", String.make 56 'a';
+  "63 bytes", String.make 63 'a';
+  "64 bytes", String.make 64 'a';
+  "65 bytes", String.make 65 'a';
+  "119 bytes", String.make 119 'a';
+  "120 bytes", String.make 120 'a';
+  "448 bits", "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+  "1M a", String.make 1_000_000 'a';
+]
+
+(* Files are read in 64KiB chunks: these sizes end inside the first block, on
+   a block boundary, just past a chunk, and past 1MiB *)
+let file_sizes = [0; 64; 65537; 1 lsl 20 + 1]
+
+let content n = String.init n (fun i -> Char.chr ((i * 7 + 3) mod 256))
+
+let run kernel =
+  Printf.printf "== %s kernel ==\n" kernel;
+  List.iter (fun (label, s) ->
+      Printf.printf "%-10s %s\n" label (OpamStubs.sha256_string s))
+    strings;
+  List.iter (fun n ->
+      let file = Filename.temp_file "opam-sha" "" in
+      OpamStd.Exn.finally (fun () -> Sys.remove file) @@ fun () ->
+      let oc = open_out_bin file in
+      output_string oc (content n);
+      close_out oc;
+      let digest = OpamStubs.sha256_file file in
+      let _, digest', _ =
+        OpamStubs.hash_file file ~md5:false ~sha256:true ~sha512:false
+      in
+      Printf.printf "file %-7d %s%s\n" n digest
+        (if digest' = digest then "" else " (hash_file: " ^ digest' ^ ")"))
+    file_sizes
+
+let () =
+  run "default";
+  OpamStubs.sha256_force_portable true;
+  run "portable";
+  OpamStubs.sha256_force_portable false
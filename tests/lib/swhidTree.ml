@@ -0,0 +1,44 @@
+(**************************************************************************)
+(*                                                                        *)
+(*    Copyright 2026 OCamlPro                                             *)
+(*                                                                        *)
+(*  All rights reserved. This file is distributed under the terms of the  *)
+(*  GNU Lesser General Public License version 2.1, with the special       *)
+(*  exception on linking described in the file LICENSE.                   *)
+(*                                                                        *)
+(**************************************************************************)
+
+(* Checks [OpamSWHID.compute] against the tree hash given by git for the same
+   tree, with the empty directory added with [git mktree]. [group-exec] is
+   only executable by its group, which git, and Software Heritage, don't
+   count as executable. *)
+
+let files = [
+  "README", 0o644, "hello\n";
+  "run.sh", 0o744, "#!/bin/sh\necho run\n";
+  "group-exec", 0o654, "not exec\n";
+  "sub/file", 0o644, "nested\n";
+]
+
+let expected = "7e3fa10b9ceda5aa74bedf8a6fa17d5ecf0f3301"
+
+let () =
+  let dir = OpamSystem.mk_temp_dir ~prefix:"opam-swhid" () in
+  OpamStd.Exn.finally (fun () -> OpamSystem.remove_dir dir) @@ fun () ->
+  Unix.mkdir (Filename.concat dir "sub") 0o755;
+  Unix.mkdir (Filename.concat dir "empty") 0o755;
+  List.iter (fun (name, perm, contents) ->
+      let file = Filename.concat dir name in
+      OpamSystem.write file contents;
+      Unix.chmod file perm)
+    files;
+  Unix.symlink "README" (Filename.concat dir "link");
+  let check label =
+    match OpamSWHID.compute (OpamFilename.Dir.of_string dir) with
+    | Some h when h = expected -> Printf.printf "%-7s %s\n" label h
+    | Some h -> Printf.printf "%-7s %s (expected %s)\n" label h expected
+    | None -> Printf.printf "%-7s failed\n" label
+  in
+  check "fresh";
+  (* The second run takes the blob digests from the cache *)
+  check "cached"
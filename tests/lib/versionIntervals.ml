@@ -0,0 +1,125 @@
+(**************************************************************************)
+(*                                                                        *)
+(*    Copyright 2026 OCamlPro                                             *)
+(*                                                                        *)
+(*  All rights reserved. This file is distributed under the terms of the  *)
+(*  GNU Lesser General Public License version 2.1, with the special       *)
+(*  exception on linking described in the file LICENSE.                   *)
+(*                                                                        *)
+(**************************************************************************)
+
+(* Checks that the package selection functions of [OpamFormula], which compile
+   version formulas to intervals, agree with [check_version_formula] *)
+
+open OpamFormula
+
+let name = OpamPackage.Name.of_string "a"
+
+let v = OpamPackage.Version.of_string
+
+(* Including versions with [~], and versions just around the bounds used in
+   formulas *)
+let versions =
+  List.map v ["0"; "0.9"; "1~beta"; "1"; "1.0"; "1.0.1"; "1.5"; "2~rc";
+              "2"; "2.1"; "3"; "3.0~"; "4"; "10"]
+
+let bounds = List.map v ["1"; "1.0"; "2"; "3"; "5"]
+
+let pkgs =
+  OpamPackage.Set.of_list (List.map (OpamPackage.create name) versions)
+
+let expected f =
+  OpamPackage.Set.filter (fun nv ->
+      check_version_formula f (OpamPackage.version nv))
+    pkgs
+
+let to_string f =
+  string_of_formula (fun (relop, v) ->
+      Printf.sprintf "%s %s" (string_of_relop relop)
+        (OpamPackage.Version.to_string v))
+    f
+
+let set_to_string s =
+  OpamStd.List.concat_map " " (fun nv ->
+      OpamPackage.Version.to_string (OpamPackage.version nv))
+    (OpamPackage.Set.elements s)
+
+let failures = ref 0
+
+let check f =
+  let exp = expected f in
+  let fail what got =
+    incr failures;
+    Printf.printf "MISMATCH %s for %s: got {%s}, expected {%s}\n"
+      what (to_string f) (set_to_string got) (set_to_string exp)
+  in
+  let got = packages pkgs (Atom (name, f)) in
+  if not (OpamPackage.Set.equal got exp) then fail "packages" got;
+  let sat =
+    OpamPackage.Set.filter (fun nv ->
+        satisfies_depends (OpamPackage.Set.singleton nv) (Atom (name, f)))
+      pkgs
+  in
+  if not (OpamPackage.Set.equal sat exp) then fail "satisfies_depends" sat;
+  exp
+
+(* Single constraints and pairs of them also go through [packages_of_atoms],
+   as a conjunction and as a disjunction *)
+let check_atoms cstrs =
+  let atoms = List.map (fun c -> name, Some c) cstrs in
+  let atom c = Atom c in
+  List.iter (fun (disj, f) ->
+      let f = f (List.map atom cstrs) in
+      let exp = expected f in
+      let got = packages_of_atoms ~disj pkgs atoms in
+      if not (OpamPackage.Set.equal got exp) then
+        (incr failures;
+         Printf.printf "MISMATCH packages_of_atoms for %s: got {%s}, \
+                        expected {%s}\n"
+           (to_string f) (set_to_string got) (set_to_string exp)))
+    [false, ands; true, ors]
+
+let random_formula () =
+  let pick l = List.nth l (Random.int (List.length l)) in
+  let rec aux depth =
+    match Random.int (if depth = 0 then 2 else 6) with
+    | 0 -> Empty
+    | 1 -> Atom (pick all_relop, pick bounds)
+    | 2 -> Block (aux (depth - 1))
+    | 3 | 4 -> And (aux (depth - 1), aux (depth - 1))
+    | _ -> Or (aux (depth - 1), aux (depth - 1))
+  in
+  aux 4
+
+let () =
+  let a r s = Atom (r, v s) in
+  let show label f =
+    Printf.printf "%-11s %-32s {%s}\n" label (to_string f)
+      (set_to_string (check f))
+  in
+  show "neq" (a `Neq "1");
+  show "empty" Empty;
+  show "empty-and" (And (Empty, a `Lt "2"));
+  show "empty-or" (Or (Empty, a `Lt "2"));
+  show "touch-incl" (Or (a `Lt "2", a `Geq "2"));
+  show "touch-excl" (Or (a `Lt "2", a `Gt "2"));
+  show "touch-and" (And (a `Leq "2", a `Geq "2"));
+  show "disjoint" (And (a `Lt "2", a `Gt "2"));
+  show "neq-and" (And (a `Neq "1", a `Neq "3"));
+  show "neq-or" (Or (a `Neq "1", a `Neq "3"));
+  show "nested"
+    (And (Block (Or (And (a `Geq "1", a `Lt "2"),
+                     And (a `Gt "2", a `Leq "3"))),
+          Or (a `Neq "1.0", a `Eq "3")));
+  show "nested-or"
+    (Or (And (a `Gt "1", Block (Or (a `Lt "2", a `Eq "4"))),
+         And (Empty, a `Eq "0")));
+  List.iter (fun r ->
+      List.iter (fun r' ->
+          List.iter (fun b -> check_atoms [r, b; r', v "2"]) bounds)
+        all_relop)
+    all_relop;
+  Random.init 42;
+  let n = 5000 in
+  for _ = 1 to n do ignore (check (random_formula ())) done;
+  Printf.printf "%d random formulas checked, %d mismatches\n" n !failures
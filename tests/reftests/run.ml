@@ -642,6 +642,12 @@ let common_filters ?opam dir =
       str ".cache";
     ],
     Sed "state-magicv.cache";
+    seq [
+      str "search-";
+      repn xdigit 8 (Some 8);
+      str ".cache";
+    ],
+    Sed "search-magicv.cache";
     with_hexa_twice "log",
     Sed "log-xxx";
     with_hexa_twice "patch",